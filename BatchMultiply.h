@@ -0,0 +1,109 @@
+/*
+ * BatchMultiply class multiplies many equally shaped small matrices at once
+ *
+ * Operands use an interleaved batch layout: element (i, j) of matrix b in a batch of "batch" matrices
+ * with "cols" columns is stored at data[(i * cols + j) * batch + b].
+ * The innermost loop therefore runs over the batch with unit stride and vectorizes,
+ * no matter how small each matrix is.
+ *
+ * Details:
+ *
+ * 1.   Caller provided storage for operands and results, nothing is allocated per product
+ * 2.   Batch processed in CHUNK sized slices so a slice of every operand stays in cache
+ * 3.   Slices split across threads
+ * 4.   pack() and unpack() convert between SafeMatrix objects and the interleaved layout
+ */
+
+#ifndef SAFEARRAY_BATCHMULTIPLY_H
+#define SAFEARRAY_BATCHMULTIPLY_H
+
+#include "SafeMatrix.h"
+#include "Parallel.h"
+
+template <typename T>
+class BatchMultiply {
+private:
+    // matrices per slice, a multiple of every SIMD width
+    enum { CHUNK = 256 };
+
+public:
+    // c[b] = a[b] * b[b] for every b, a is "m" by "k", b is "k" by "n" and c is "m" by "n"
+    static void multiply(const T * l_a, const T * l_b, T * l_c, int m, int k, int n, long l_batch,
+                         int l_threads = 0) {
+        Parallel::forRange(0, (l_batch + CHUNK - 1) / CHUNK, l_threads, 1, [&](long l_first, long l_last) {
+            for (long chunk = l_first; chunk < l_last; chunk++) {
+                long _begin = chunk * CHUNK;
+                long _end = std::min(l_batch, _begin + CHUNK);
+                multiplySlice(l_a, l_b, l_c, m, k, n, l_batch, _begin, _end);
+            }
+        });
+    }
+
+    // copy "l_batch" SafeMatrix objects of equal shape into the interleaved layout at "l_data"
+    static void pack(SafeMatrix<T> * const * l_matrices, long l_batch, T * l_data) {
+        // an empty batch has no first matrix to take the shape from
+        if (l_batch <= 0) return;
+        int rows = l_matrices[0]->rowHigh - l_matrices[0]->rowLow + 1;
+        int cols = l_matrices[0]->colHigh - l_matrices[0]->colLow + 1;
+        for (long b = 0; b < l_batch; b++) {
+            requireShape(* l_matrices[b], rows, cols);
+            for (int row = 0; row < rows; row++) {
+                const T * _row = l_matrices[b]->matrix[row]->constData();
+                for (int col = 0; col < cols; col++) {
+                    l_data[((long) row * cols + col) * l_batch + b] = _row[col];
+                }
+            }
+        }
+    }
+
+    // copy the interleaved layout at "l_data" back into "l_batch" SafeMatrix objects of equal shape
+    static void unpack(const T * l_data, long l_batch, SafeMatrix<T> * const * l_matrices) {
+        if (l_batch <= 0) return;
+        int rows = l_matrices[0]->rowHigh - l_matrices[0]->rowLow + 1;
+        int cols = l_matrices[0]->colHigh - l_matrices[0]->colLow + 1;
+        for (long b = 0; b < l_batch; b++) {
+            requireShape(* l_matrices[b], rows, cols);
+            for (int row = 0; row < rows; row++) {
+                T * _row = l_matrices[b]->rows()[row]->data();
+                for (int col = 0; col < cols; col++) {
+                    _row[col] = l_data[((long) row * cols + col) * l_batch + b];
+                }
+            }
+        }
+    }
+
+private:
+    static void multiplySlice(const T * __restrict l_a, const T * __restrict l_b, T * __restrict l_c,
+                              int m, int k, int n, long l_batch, long l_begin, long l_end) {
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                T * __restrict _c = l_c + ((long) i * n + j) * l_batch;
+                for (long b = l_begin; b < l_end; b++) {
+                    _c[b] = T();
+                }
+                for (int p = 0; p < k; p++) {
+                    const T * __restrict _a = l_a + ((long) i * k + p) * l_batch;
+                    const T * __restrict _b = l_b + ((long) p * n + j) * l_batch;
+                    for (long b = l_begin; b < l_end; b++) {
+                        _c[b] += _a[b] * _b[b];
+                    }
+                }
+            }
+        }
+    }
+
+    static void requireShape(const SafeMatrix<T> & l_SafeMatrix, int l_rows, int l_cols) {
+        if (l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1 != l_rows
+            || l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1 != l_cols) {
+            if (SAFEARRAY_SAFEMATRIX_DEBUG) {
+                std::cout << "Arithmetic error: batch shape "
+                          << l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1 << ","
+                          << l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1 << " "
+                          << l_rows << "," << l_cols << std::endl;
+            }
+            exit(1);
+        }
+    }
+};
+
+#endif //SAFEARRAY_BATCHMULTIPLY_H
@@ -1,10 +1,17 @@
 /*
  * Block class implements a custom memory allocator for 1D arrays
  *
- * These variables from Block class effect memory efficiency and throughput:
- * INITDATASIZE     is the amount of words a block can store at initialization
- * INITBLOCKCOUNT   is the amount of blocks created at initialization
- * MINDATASIZE      is the minimum size of data in split(top) block
+ * These variables from BlockConfig effect memory efficiency and throughput:
+ * dataSize         is the amount of words a block of a new arena can store (INITDATASIZE by default)
+ * blockCount       is the amount of blocks a new arena is split into (INITBLOCKCOUNT by default)
+ * minDataSize      is the minimum size of data in split(top) block (MINDATASIZE)
+ * maxArenas        is the amount of arenas the pool may grow to, 0 for no limit, dedicated arenas are not counted
+ * adaptive         reshapes new arenas and MINDATASIZE from the request sizes seen so far
+ *
+ * Geometry is set with Block<T>::configure() or the environment variables
+ * SAFEARRAY_BLOCK_DATASIZE, SAFEARRAY_BLOCK_COUNT, SAFEARRAY_BLOCK_MINDATASIZE, SAFEARRAY_BLOCK_ARENAS
+ * and SAFEARRAY_BLOCK_ADAPTIVE, read when the first block is allocated. configure() wins over the environment
+ * and applies to arenas created after the call.
  *
  * Details:
  *
@@ -14,14 +21,47 @@
  * 4.   Immediate coalescing
  * 5.   Explicit free list
  * 6.   LIFO
- * 7.   Static memory pool
+ * 7.   Static memory pool, grown by whole arenas up to maxArenas
+ * 8.   Fence tags at both ends of every arena, coalescing never crosses into a neighbouring arena
+ * 9.   Requests larger than dataSize get a dedicated arena sized for them, whatever maxArenas is
  */
 
 #ifndef SAFEARRAY_BLOCK_H
 #define SAFEARRAY_BLOCK_H
+#ifndef SAFEARRAY_BLOCK_DEBUG
 #define SAFEARRAY_BLOCK_DEBUG true
+#endif
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include "Trace.h"
+
+// geometry of the arenas of a Block<T> pool, see Block<T>::configure()
+struct BlockConfig {
+    // words of data per block in a new arena
+    std::size_t dataSize = 64;
+    // blocks per new arena
+    int blockCount = 100;
+    // a block is only split if the remainder can hold more than this many words
+    int minDataSize = 32;
+    // arenas the pool may grow to, 0 for no limit, arenas dedicated to requests wider than dataSize do not count
+    int maxArenas = 1;
+    // reshape new arenas and minDataSize from the observed request sizes
+    bool adaptive = false;
+
+    // defaults overridden by the SAFEARRAY_BLOCK_* environment variables that are set
+    static BlockConfig fromEnvironment() {
+        BlockConfig _config;
+        if (const char * _value = std::getenv("SAFEARRAY_BLOCK_DATASIZE")) _config.dataSize = std::strtoul(_value, nullptr, 10);
+        if (const char * _value = std::getenv("SAFEARRAY_BLOCK_COUNT")) _config.blockCount = std::atoi(_value);
+        if (const char * _value = std::getenv("SAFEARRAY_BLOCK_MINDATASIZE")) _config.minDataSize = std::atoi(_value);
+        if (const char * _value = std::getenv("SAFEARRAY_BLOCK_ARENAS")) _config.maxArenas = std::atoi(_value);
+        if (const char * _value = std::getenv("SAFEARRAY_BLOCK_ADAPTIVE")) _config.adaptive = std::atoi(_value) != 0;
+        return _config;
+    }
+};
 
 template <typename T>
 class Block {
@@ -43,14 +83,22 @@ private:
     // minimum block size in words
     static int MINDATASIZE;
 
-    // initial data size in words
+    // default data size in words, header and footer sizes are fixed by the layout of Header and Footer
     enum { INITDATASIZE = 64, INITBLOCKCOUNT = 100, SIZEOFHEAD = 4, SIZEOFFOOT = 2, OFFSET = SIZEOFHEAD + SIZEOFFOOT};
 
+    // request histogram buckets, bucket b counts requests of 2^(b-1) to 2^b - 1 words
+    enum { BUCKETS = 64 };
+
     // memory pool
-    static uintptr_t * LMEMPOOLBOUND;
-    static uintptr_t * RMEMPOOLBOUND;
     static Header * MEMPOOL;
     static Header * AV;
+    // head of the circular free list, never allocated, so the list is never left without an entry
+    static Header FREELIST;
+    static BlockConfig CONFIG;
+    static bool CONFIGURED;
+    static std::size_t HISTOGRAM[BUCKETS];
+    // largest request seen in each bucket
+    static std::size_t LARGEST[BUCKETS];
 
 public:
 
@@ -65,75 +113,152 @@ public:
         // destructor message in operator delete
     }
 
-    static Header * initialPool() {
-        // get contiguous memory pool from OS
-        Header * _poolStart = reinterpret_cast<Header *>(new uintptr_t[(INITDATASIZE + OFFSET) * INITBLOCKCOUNT]);
+    // geometry for arenas created from now on, MINDATASIZE changes immediately
+    static void configure(const BlockConfig & l_config) {
+        CONFIG = l_config;
+        CONFIGURED = true;
+        MINDATASIZE = CONFIG.minDataSize;
+    }
+
+    static const BlockConfig & configuration() {
+        if (!CONFIGURED)
+            configure(BlockConfig::fromEnvironment());
+        return CONFIG;
+    }
+
+    /*
+     * get a contiguous arena of "_blockCount" blocks of "_dataSize" words from OS and put its blocks on the free list
+     * the arena starts with a footer and ends with a header tagged as in use, so blocks at either end
+     * see an allocated neighbour and never coalesce past the arena
+     */
+    static Header * addArena(std::size_t _dataSize, int _blockCount) {
+        std::size_t _blockSize = _dataSize + OFFSET;
+        uintptr_t * _arena = new uintptr_t[SIZEOFFOOT + _blockSize * _blockCount + SIZEOFHEAD];
         if (SAFEARRAY_BLOCK_DEBUG) {
-            std::cout << (INITDATASIZE + OFFSET) * INITBLOCKCOUNT * sizeof(uintptr_t) << " bytes initialized"
-                      << std::endl;
+            std::cout << (SIZEOFFOOT + _blockSize * _blockCount + SIZEOFHEAD) * sizeof(uintptr_t)
+                      << " bytes initialized" << std::endl;
         }
 
         // failed to get contiguous memory pool
-        if (!_poolStart) {
+        if (!_arena) {
             if (SAFEARRAY_BLOCK_DEBUG) std::cout << "Error: failed calloc" << std::endl;
             exit(1);
         }
 
-        // left bound of memory pool
-        LMEMPOOLBOUND = reinterpret_cast<uintptr_t *>(_poolStart);
+        // empty free list points at itself
+        if (!FREELIST.RLINK) {
+            FREELIST.LLINK = FREELIST.RLINK = & FREELIST;
+            FREELIST.TAG = true;
+            FREELIST.SIZE = 0;
+            AV = & FREELIST;
+        }
+
+        // left fence
+        reinterpret_cast<Footer *>(_arena)->TAG = true;
+        reinterpret_cast<Footer *>(_arena)->UPLINK = nullptr;
 
-        // beginning of memory pool
-        Header * _head = reinterpret_cast<Header *>(_poolStart);
+        // beginning of arena
+        Header * _poolStart = reinterpret_cast<Header *>(_arena + SIZEOFFOOT);
+        Header * _head = _poolStart;
 
         // initialize blocks
-        for (int i = 0; i < INITBLOCKCOUNT; i++) {
+        for (int i = 0; i < _blockCount; i++) {
             // set header
             // total size = block size + offset
-            _head->SIZE = INITDATASIZE + OFFSET;
+            _head->SIZE = _blockSize;
             _head->TAG = false;
-            _head->LLINK = reinterpret_cast<Header *>(reinterpret_cast<uintptr_t *>
-                    (_head) - INITDATASIZE - OFFSET);
-            _head->RLINK = reinterpret_cast<Header *>(reinterpret_cast<uintptr_t *>
-                    (_head) + INITDATASIZE + OFFSET);
+            _head->LLINK = reinterpret_cast<Header *>(reinterpret_cast<uintptr_t *>(_head) - _blockSize);
+            _head->RLINK = reinterpret_cast<Header *>(reinterpret_cast<uintptr_t *>(_head) + _blockSize);
 
             // set footer
             reinterpret_cast<Footer *>(reinterpret_cast<uintptr_t *>
-                (_head) + INITDATASIZE + SIZEOFHEAD)->TAG = false;
+                (_head) + _dataSize + SIZEOFHEAD)->TAG = false;
             reinterpret_cast<Footer *>(reinterpret_cast<uintptr_t *>
-                (_head) + INITDATASIZE + SIZEOFHEAD)->UPLINK = _head;
+                (_head) + _dataSize + SIZEOFHEAD)->UPLINK = _head;
 
             // initialize next block in memory
             _head = _head->RLINK;
         }
 
-        // right bound of memory pool
-        RMEMPOOLBOUND = reinterpret_cast<uintptr_t *>(_head);
+        // right fence
+        _head->TAG = true;
+        _head->SIZE = 0;
+        _head->LLINK = _head->RLINK = nullptr;
 
-        // last block in memory pool
-        _head = reinterpret_cast<Header *>(reinterpret_cast<uintptr_t *>
-                (_head) - INITDATASIZE - OFFSET);
+        // last block in arena
+        Header * _last = reinterpret_cast<Header *>(reinterpret_cast<uintptr_t *>(_head) - _blockSize);
 
-        // link blocks at both ends of memory pool
-        _head->RLINK = _poolStart;
-        _poolStart->LLINK = _head;
-
-        // set starting position of next search
-        AV = _head;
+        // splice the blocks in to the right of the next search position
+        _poolStart->LLINK = AV;
+        _last->RLINK = AV->RLINK;
+        AV->RLINK->LLINK = _last;
+        AV->RLINK = _poolStart;
 
         // statistic collection
-        blockCnt = INITBLOCKCOUNT;
+        blockCnt += _blockCount;
+        arenaCnt++;
 
-        // return start address of memory pool
+        // return start address of arena
         return _poolStart;
     }
 
+    /*
+     * add an arena that can satisfy a request of "_size" words including offset, false once maxArenas is reached
+     * requests larger than dataSize get a dedicated arena with about the memory of a normal arena, its blocks are
+     * rounded up to a power of two so later large requests can reuse them, maxArenas does not apply to it
+     * in adaptive mode blocks are sized for 90% of the requests seen so far and MINDATASIZE follows their median
+     */
+    static bool grow(std::size_t _size) {
+        const BlockConfig & _config = configuration();
+        bool _dedicated = _size - OFFSET > _config.dataSize;
+        if (!_dedicated && _config.maxArenas > 0 && arenaCnt - dedicatedCnt >= _config.maxArenas) return false;
+        // every new arena keeps the memory of a configured arena, only its block geometry changes
+        std::size_t _arenaSize = (_config.dataSize + OFFSET) * _config.blockCount;
+        std::size_t _dataSize = _config.dataSize;
+        int _blockCount = _config.blockCount;
+        if (_config.adaptive && requestCnt > 0) {
+            _dataSize = std::max<std::size_t>(percentile(0.9), 1);
+            _blockCount = std::max<std::size_t>(1, _arenaSize / (_dataSize + OFFSET));
+            MINDATASIZE = (int) percentile(0.5);
+        }
+        if (_size - OFFSET > _dataSize) {
+            _dataSize = 1;
+            while (_dataSize < _size - OFFSET) _dataSize <<= 1;
+            _blockCount = std::max<std::size_t>(1, _arenaSize / (_dataSize + OFFSET));
+        }
+        addArena(_dataSize, std::max(_blockCount, 1));
+        if (_dedicated) dedicatedCnt++;
+        return true;
+    }
+
+    // largest request in words of the histogram bucket below which "_fraction" of the requests fall
+    static std::size_t percentile(double _fraction) {
+        std::size_t _total = 0;
+        for (std::size_t count : HISTOGRAM) _total += count;
+        std::size_t _seen = 0;
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {
+            _seen += HISTOGRAM[bucket];
+            if (_seen >= _fraction * _total) return LARGEST[bucket];
+        }
+        return 0;
+    }
+
+    // number of significant bits of "_words"
+    static int bucket(std::size_t _words) {
+        int _bucket = 0;
+        while (_words) {
+            _bucket++;
+            _words >>= 1;
+        }
+        return _bucket;
+    }
+
     static Block<T> * allocate(std::size_t _size) {
         // initialize memory pool
-        if (!MEMPOOL)
-            MEMPOOL = initialPool();
-
-        // start search from free list
-        Header * _freeHead = AV->RLINK;
+        if (!MEMPOOL) {
+            const BlockConfig & _config = configuration();
+            MEMPOOL = addArena(_config.dataSize, _config.blockCount);
+        }
 
         // align and set size in terms of words including header and footer offset
         _size = align(_size) / sizeof(uintptr_t) + OFFSET;
@@ -142,13 +267,20 @@ public:
         requestCnt++;
         requestSize = _size - OFFSET;
         searchCnt = 1;
+        if (CONFIG.adaptive) {
+            int _bucket = std::min<int>(bucket(_size - OFFSET), BUCKETS - 1);
+            HISTOGRAM[_bucket]++;
+            LARGEST[_bucket] = std::max(LARGEST[_bucket], _size - OFFSET);
+        }
 
-        // search through blocks on the free list
-        while (_freeHead->TAG == false && _freeHead->SIZE >= _size) {
+        // one lap of the free list from the next search position, then grow the pool and search again
+        Header * _start = AV;
+        Header * _freeHead = AV->RLINK;
+        while (true) {
             // statistic collection
             searchCnt++;
 
-            // block with enough memory
+            // block with enough memory, the list head has size 0
             if (_freeHead->SIZE >= _size) {
                 int _difference = _freeHead->SIZE - _size;
 
@@ -181,7 +313,9 @@ public:
                     // top block size
                     _freeHead->SIZE = _difference;
 
-                    // uplink of top block
+                    // footer of top block
+                    reinterpret_cast<Footer *>(reinterpret_cast<uintptr_t *>
+                        (_freeHead) + _freeHead->SIZE - SIZEOFFOOT)->TAG = false;
                     reinterpret_cast<Footer *>(reinterpret_cast<uintptr_t *>
                         (_freeHead) + _freeHead->SIZE - SIZEOFFOOT)->UPLINK = _freeHead;
 
@@ -217,6 +351,15 @@ public:
                         (_newHead) + SIZEOFHEAD);
                 }
             }
+            // whole list searched
+            if (_freeHead == _start) {
+                if (!grow(_size)) break;
+                // new blocks are spliced in right after AV
+                _start = AV;
+                _freeHead = AV->RLINK;
+                continue;
+            }
+
             // search next block on free list
             _freeHead = _freeHead->RLINK;
         }
@@ -242,17 +385,13 @@ public:
         Header * _leftHead = nullptr;
         Header * _rightHead = nullptr;
 
-        // get head and tag of adjacent blocks within memory bounds
-        if (LMEMPOOLBOUND != reinterpret_cast<uintptr_t *>(_head)) {
-            _leftHead = reinterpret_cast<Footer *>(reinterpret_cast<uintptr_t *>
-                (_head) - SIZEOFFOOT)->UPLINK;
-            _leftTag = _leftHead->TAG;
-        }
-        if (RMEMPOOLBOUND != reinterpret_cast<uintptr_t *> (_foot) + SIZEOFFOOT) {
-            _rightHead = reinterpret_cast<Header *>(reinterpret_cast<uintptr_t *>
-                (_foot) + SIZEOFFOOT);
-            _rightTag = _rightHead->TAG;
-        }
+        // get head and tag of adjacent blocks, the fences at the ends of an arena are tagged in use
+        Footer * _leftFoot = reinterpret_cast<Footer *>(reinterpret_cast<uintptr_t *>(_head) - SIZEOFFOOT);
+        _leftTag = _leftFoot->TAG;
+        if (_leftTag == false)
+            _leftHead = _leftFoot->UPLINK;
+        _rightHead = reinterpret_cast<Header *>(reinterpret_cast<uintptr_t *>(_foot) + SIZEOFFOOT);
+        _rightTag = _rightHead->TAG;
 
         // coalesce adjacent free blocks
 
@@ -335,11 +474,17 @@ public:
         }
     }
 
-    static void * operator new(std::size_t _block, std::size_t _size) {
-        return allocate(_size);
+    // noexcept, so a failed allocation yields nullptr instead of constructing at nullptr
+    static void * operator new(std::size_t _block, std::size_t _size) noexcept {
+        Block<T> * _allocated = allocate(_size);
+        if (SAFEARRAY_TRACE)
+            Trace::instant(Trace::ALLOCATE, reinterpret_cast<uintptr_t>(_allocated), _size);
+        return _allocated;
     }
 
     static void operator delete(void * _block) {
+        if (SAFEARRAY_TRACE)
+            Trace::instant(Trace::FREE, reinterpret_cast<uintptr_t>(_block));
         deallocate(reinterpret_cast<Block<T> *>(_block));
         destructorMsg();
     }
@@ -405,10 +550,59 @@ public:
     static int failureCnt; // number of times block request failed
     static int splitCnt; // number of times blocks split
     static int coalesceCnt; // number of times blocks coalesced
+    static int arenaCnt; // number of arenas in the pool
+    static int dedicatedCnt; // number of arenas added for requests larger than dataSize
 
     static double avgSearchCnt; // average number of blocks searched until request satisfied
     static double successRate; // rate of satisfied request
     static double failureRate; // rate of fail requests
 };
 
+// statistics and memory pool start empty, the pool is created by the first allocate()
+
+template <typename T>
+std::size_t Block<T>::requestSize = 0;
+template <typename T>
+std::size_t Block<T>::blockSize = 0;
+template <typename T>
+int Block<T>::blockCnt = 0;
+template <typename T>
+int Block<T>::searchCnt = 0;
+template <typename T>
+int Block<T>::requestCnt = 0;
+template <typename T>
+int Block<T>::failureCnt = 0;
+template <typename T>
+int Block<T>::splitCnt = 0;
+template <typename T>
+int Block<T>::coalesceCnt = 0;
+template <typename T>
+int Block<T>::arenaCnt = 0;
+template <typename T>
+int Block<T>::dedicatedCnt = 0;
+template <typename T>
+double Block<T>::avgSearchCnt = 0;
+template <typename T>
+double Block<T>::successRate = 0;
+template <typename T>
+double Block<T>::failureRate = 0;
+
+template <typename T>
+typename Block<T>::Header * Block<T>::MEMPOOL;
+template <typename T>
+typename Block<T>::Header * Block<T>::AV;
+template <typename T>
+typename Block<T>::Header Block<T>::FREELIST;
+template <typename T>
+BlockConfig Block<T>::CONFIG;
+template <typename T>
+bool Block<T>::CONFIGURED = false;
+template <typename T>
+std::size_t Block<T>::HISTOGRAM[BUCKETS];
+template <typename T>
+std::size_t Block<T>::LARGEST[BUCKETS];
+
+template <typename T>
+int Block<T>::MINDATASIZE = 32; // must be greater than 6
+
 #endif //SAFEARRAY_BLOCK_H
\ No newline at end of file
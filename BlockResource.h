@@ -0,0 +1,96 @@
+/*
+ * BlockResource class is a std::pmr::memory_resource backed by the Block pool
+ *
+ * Any pmr container can draw from the same next fit pool as SafeArray, e.g.
+ * "BlockResource<> pool; std::pmr::vector<int> index(&pool);". A resource can also be handed to
+ * SafeArray, SafeMatrix and VNT, which then take their elements from it.
+ *
+ * Details:
+ *
+ * 1.   The pool is Block<Pool>, every Pool type is a separate pool with its own BlockConfig and statistics,
+ *      so "BlockResource<Physics>" keeps a subsystem in memory of its own (Pool must be a complete type)
+ * 2.   Block data is word aligned, stricter alignments are met by over allocating, the Block address is kept
+ *      in the word before the aligned memory
+ * 3.   A request the pool cannot satisfy throws std::bad_alloc, as memory_resource requires
+ * 4.   Resources of the same Pool type share one pool and compare equal
+ * 5.   Not synchronized, like Block itself
+ */
+
+#ifndef SAFEARRAY_BLOCKRESOURCE_H
+#define SAFEARRAY_BLOCKRESOURCE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include "Block.h"
+
+template <typename Pool = unsigned char>
+class BlockResource : public std::pmr::memory_resource {
+public:
+    // requests made through this resource
+    struct Statistics {
+        std::size_t allocations = 0;
+        std::size_t deallocations = 0;
+        std::size_t failures = 0;
+        // bytes requested and not yet released, and the most there ever were
+        std::size_t bytes = 0;
+        std::size_t peak = 0;
+    };
+
+private:
+    Statistics statistics;
+
+public:
+    BlockResource() = default;
+
+    BlockResource(const BlockResource &) = delete;
+    BlockResource & operator=(const BlockResource &) = delete;
+
+    const Statistics & getStatistics() const {
+        return statistics;
+    }
+
+    // geometry of the shared Block<Pool> pool, see Block<T>::configure()
+    static void configure(const BlockConfig & l_config) {
+        Block<Pool>::configure(l_config);
+    }
+
+protected:
+    void * do_allocate(std::size_t l_bytes, std::size_t l_alignment) override {
+        // a word aligned block serves every alignment up to a word, larger ones need room to shift
+        bool _shift = l_alignment > sizeof(uintptr_t);
+        Block<Pool> * _block = Block<Pool>::allocate(_shift ? l_bytes + l_alignment : l_bytes);
+        if (!_block) {
+            statistics.failures++;
+            throw std::bad_alloc();
+        }
+        if (SAFEARRAY_TRACE)
+            Trace::instant(Trace::ALLOCATE, reinterpret_cast<uintptr_t>(_block), l_bytes);
+        statistics.allocations++;
+        statistics.bytes += l_bytes;
+        statistics.peak = std::max(statistics.peak, statistics.bytes);
+        if (!_shift) return _block;
+        // the shift is at least a word, so the word before the result is free for the Block address
+        uintptr_t _address = reinterpret_cast<uintptr_t>(_block);
+        uintptr_t _aligned = (_address + l_alignment) & ~(uintptr_t) (l_alignment - 1);
+        reinterpret_cast<Block<Pool> **>(_aligned)[-1] = _block;
+        return reinterpret_cast<void *>(_aligned);
+    }
+
+    void do_deallocate(void * l_memory, std::size_t l_bytes, std::size_t l_alignment) override {
+        Block<Pool> * _block = l_alignment > sizeof(uintptr_t) ? static_cast<Block<Pool> **>(l_memory)[-1]
+                                                               : static_cast<Block<Pool> *>(l_memory);
+        if (SAFEARRAY_TRACE)
+            Trace::instant(Trace::FREE, reinterpret_cast<uintptr_t>(_block));
+        statistics.deallocations++;
+        statistics.bytes -= l_bytes;
+        Block<Pool>::deallocate(_block);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & l_other) const noexcept override {
+        return dynamic_cast<const BlockResource *>(& l_other) != nullptr;
+    }
+};
+
+#endif //SAFEARRAY_BLOCKRESOURCE_H
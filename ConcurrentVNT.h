@@ -0,0 +1,169 @@
+/*
+ * ConcurrentVNT class is a priority queue shared by many threads, built from several VNT shards
+ *
+ * Every shard is a VNT guarded by its own mutex, with its minimum cached in an atomic
+ * so threads can compare shards without locking them.
+ *
+ * push()       start at a random shard and take the first one that is free and not full,
+ *              if every shard is busy wait for each in turn
+ * tryPop()     RELAXED  MultiQueue: lock the shard with the smaller minimum of two random shards,
+ *                       the result is close to, but not always, the global minimum
+ *              STRICT   lock every shard in order and extract the global minimum
+ *
+ * Shards are created up front, so no thread ever allocates from the Block pool.
+ */
+
+#ifndef SAFEARRAY_CONCURRENTVNT_H
+#define SAFEARRAY_CONCURRENTVNT_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "VNT.h"
+
+template <typename T>
+class ConcurrentVNT {
+public:
+    enum Mode { RELAXED, STRICT };
+
+private:
+    // one cache line per shard so neighbouring locks do not share a line
+    struct alignas(64) Shard {
+        std::mutex lock;
+        VNT<T> * table = nullptr;
+        std::atomic<T> min;
+    };
+
+    // random attempts before a relaxed pop falls back to scanning every shard
+    enum { ATTEMPTS = 8 };
+
+    T _MAX;
+    Mode mode;
+    int capacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<long> count;
+
+public:
+    // "l_shards" tables of "m" by "n", pass about twice the number of threads for RELAXED
+    ConcurrentVNT(int l_shards, const int & m, const int & n, const T & max, Mode l_mode = RELAXED)
+            : _MAX(max), mode(l_mode), capacity(m * n), count(0) {
+        if (l_shards < 1) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "Constructor error: shard count " << l_shards << std::endl;
+            }
+            exit(1);
+        }
+        for (int shard = 0; shard < l_shards; shard++) {
+            shards.emplace_back(new Shard());
+            shards.back()->table = new VNT<T>(m, n, max);
+            shards.back()->min.store(max);
+        }
+    }
+
+    ConcurrentVNT(const ConcurrentVNT<T> &) = delete;
+    ConcurrentVNT<T> & operator=(const ConcurrentVNT<T> &) = delete;
+
+    ~ConcurrentVNT() {
+        for (std::unique_ptr<Shard> & shard : shards) {
+            delete shard->table;
+        }
+    }
+
+    // adds "element", false if every shard is full or "element" is not below the value limit
+    bool push(const T & element) {
+        // VNT::add ignores an element equal to _MAX, the sentinel of an empty cell
+        if (!(element < _MAX)) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "insert error: value limit " << element << std::endl;
+            }
+            return false;
+        }
+        int _shards = shards.size();
+        int _start = random() % _shards;
+        // first pass skips busy shards, second pass waits for them
+        for (int pass = 0; pass < 2; pass++) {
+            for (int offset = 0; offset < _shards; offset++) {
+                Shard & _shard = * shards[(_start + offset) % _shards];
+                std::unique_lock<std::mutex> _guard(_shard.lock, std::defer_lock);
+                if (pass == 0) {
+                    if (!_guard.try_lock()) continue;
+                } else {
+                    _guard.lock();
+                }
+                if (_shard.table->size() == capacity) continue;
+                _shard.table->add(element);
+                _shard.min.store(_shard.table->getMin(), std::memory_order_relaxed);
+                count.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // removes a minimum into "element" following the queue's mode, false if the queue was empty
+    bool tryPop(T & element) {
+        if (mode == STRICT) return popStrict(element);
+        int _shards = shards.size();
+        for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+            Shard & _first = * shards[random() % _shards];
+            Shard & _second = * shards[random() % _shards];
+            Shard & _best = _second.min.load(std::memory_order_relaxed) < _first.min.load(std::memory_order_relaxed)
+                            ? _second : _first;
+            if (_best.min.load(std::memory_order_relaxed) == _MAX) continue;
+            std::unique_lock<std::mutex> _guard(_best.lock, std::try_to_lock);
+            if (!_guard.owns_lock() || _best.table->isEmpty()) continue;
+            element = extract(_best);
+            return true;
+        }
+        // queue nearly empty or heavily contended, take the first shard with anything in it
+        for (std::unique_ptr<Shard> & shard : shards) {
+            std::lock_guard<std::mutex> _guard(shard->lock);
+            if (shard->table->isEmpty()) continue;
+            element = extract(* shard);
+            return true;
+        }
+        return false;
+    }
+
+    // number of elements, exact only while no other thread is pushing or popping
+    long size() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+private:
+    bool popStrict(T & element) {
+        // locks are always taken in shard order, so strict pops cannot deadlock
+        std::vector<std::unique_lock<std::mutex>> _guards;
+        _guards.reserve(shards.size());
+        Shard * _best = nullptr;
+        for (std::unique_ptr<Shard> & shard : shards) {
+            _guards.emplace_back(shard->lock);
+            if (!shard->table->isEmpty() && (!_best || shard->table->getMin() < _best->table->getMin()))
+                _best = shard.get();
+        }
+        if (!_best) return false;
+        element = extract(* _best);
+        return true;
+    }
+
+    // caller holds the lock of "l_shard"
+    T extract(Shard & l_shard) {
+        T _min = l_shard.table->extractMin();
+        // an empty shard caches _MAX, tryPop() skips it
+        l_shard.min.store(l_shard.table->isEmpty() ? _MAX : l_shard.table->getMin(), std::memory_order_relaxed);
+        count.fetch_sub(1, std::memory_order_relaxed);
+        return _min;
+    }
+
+    // per thread generator, seeded from the thread id so threads spread over different shards
+    static unsigned random() {
+        thread_local std::minstd_rand _generator(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        return _generator();
+    }
+};
+
+#endif //SAFEARRAY_CONCURRENTVNT_H
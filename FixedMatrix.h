@@ -0,0 +1,189 @@
+/*
+ * FixedMatrix class is a SafeMatrix whose bounds are template parameters
+ *
+ * Elements are stored inline, so a FixedMatrix never touches the Block pool or the heap.
+ * Multiply, add, subtract and transpose are unrolled at compile time over every index,
+ * which suits small matrices such as 3x3 and 4x4 transforms.
+ *
+ * Bounds checks:
+ * at<row, col>()   checked with static_assert
+ * [row][col]       checked at run time, a constant out of bounds index fails to compile in constant expressions
+ */
+
+#ifndef SAFEARRAY_FIXEDMATRIX_H
+#define SAFEARRAY_FIXEDMATRIX_H
+#ifndef SAFEARRAY_FIXEDMATRIX_DEBUG
+#define SAFEARRAY_FIXEDMATRIX_DEBUG true
+#endif
+
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <utility>
+
+template <typename T, int ROWLOW, int ROWHIGH, int COLLOW, int COLHIGH>
+class FixedMatrix {
+    static_assert(ROWHIGH - ROWLOW >= 0 && COLHIGH - COLLOW >= 0, "FixedMatrix bounds definition");
+
+public:
+    static constexpr int rowLow = ROWLOW, rowHigh = ROWHIGH, colLow = COLLOW, colHigh = COLHIGH;
+    static constexpr int ROWS = ROWHIGH - ROWLOW + 1, COLS = COLHIGH - COLLOW + 1;
+
+    T data[ROWS][COLS];
+
+    // row of a FixedMatrix allowing "a[row][column]"
+    template <typename Element>
+    class Row {
+    private:
+        Element * row;
+
+    public:
+        constexpr explicit Row(Element * l_row) : row(l_row) { }
+
+        constexpr Element & operator[](int index) const {
+            if (index < COLLOW || index > COLHIGH)
+                boundsError(index, COLLOW, COLHIGH);
+            return row[index - COLLOW];
+        }
+    };
+
+public:
+    // every element is value initialized
+    constexpr FixedMatrix() : data() { }
+
+    // initializer_list constructor to allow "FixedMatrix<T, 0, 1, 0, 1> a{ { t00, t01 }, { t10, t11 } }"
+    constexpr FixedMatrix(const std::initializer_list<std::initializer_list<T>> & l_list) : data() {
+        if ((int) l_list.size() != ROWS)
+            constructorError();
+        int row = 0;
+        for (const std::initializer_list<T> & _row : l_list) {
+            if ((int) _row.size() != COLS)
+                constructorError();
+            int col = 0;
+            for (const T & element : _row) {
+                data[row][col++] = element;
+            }
+            row++;
+        }
+    }
+
+    constexpr void fillMatrix(const T & element) {
+        unroll(std::make_index_sequence<ROWS * COLS>(), [&](auto index) {
+            data[index / COLS][index % COLS] = element;
+        });
+    }
+
+    // overload the [] operator to allow "a[row][column] = T();"
+    constexpr Row<T> operator[](int index) {
+        if (index < ROWLOW || index > ROWHIGH)
+            boundsError(index, ROWLOW, ROWHIGH);
+        return Row<T>(data[index - ROWLOW]);
+    }
+
+    constexpr Row<const T> operator[](int index) const {
+        if (index < ROWLOW || index > ROWHIGH)
+            boundsError(index, ROWLOW, ROWHIGH);
+        return Row<const T>(data[index - ROWLOW]);
+    }
+
+    // element access with both indices checked at compile time
+    template <int ROW, int COL>
+    constexpr T & at() {
+        static_assert(ROW >= ROWLOW && ROW <= ROWHIGH && COL >= COLLOW && COL <= COLHIGH,
+                      "Index selector error: bounds selection");
+        return data[ROW - ROWLOW][COL - COLLOW];
+    }
+
+    template <int ROW, int COL>
+    constexpr const T & at() const {
+        static_assert(ROW >= ROWLOW && ROW <= ROWHIGH && COL >= COLLOW && COL <= COLHIGH,
+                      "Index selector error: bounds selection");
+        return data[ROW - ROWLOW][COL - COLLOW];
+    }
+
+    // FixedMatrix a(x,y) = b(x,y) + c(m,n) if and only if x = m and y = n, checked at compile time
+    template <int RL, int RH, int CL, int CH>
+    constexpr FixedMatrix operator+(const FixedMatrix<T, RL, RH, CL, CH> & l_FixedMatrix) const {
+        static_assert(RH - RL + 1 == ROWS && CH - CL + 1 == COLS, "Arithmetic error: matrix addition");
+        FixedMatrix _result;
+        unroll(std::make_index_sequence<ROWS * COLS>(), [&](auto index) {
+            _result.data[index / COLS][index % COLS] = data[index / COLS][index % COLS]
+                                                       + l_FixedMatrix.data[index / COLS][index % COLS];
+        });
+        return _result;
+    }
+
+    template <int RL, int RH, int CL, int CH>
+    constexpr FixedMatrix operator-(const FixedMatrix<T, RL, RH, CL, CH> & l_FixedMatrix) const {
+        static_assert(RH - RL + 1 == ROWS && CH - CL + 1 == COLS, "Arithmetic error: matrix subtraction");
+        FixedMatrix _result;
+        unroll(std::make_index_sequence<ROWS * COLS>(), [&](auto index) {
+            _result.data[index / COLS][index % COLS] = data[index / COLS][index % COLS]
+                                                       - l_FixedMatrix.data[index / COLS][index % COLS];
+        });
+        return _result;
+    }
+
+    // FixedMatrix a(x,n) = b(x,y) * c(m,n) if and only if y = m, checked at compile time
+    template <int RL, int RH, int CL, int CH>
+    constexpr FixedMatrix<T, ROWLOW, ROWHIGH, CL, CH> operator*(const FixedMatrix<T, RL, RH, CL, CH> & l_FixedMatrix) const {
+        static_assert(RH - RL + 1 == COLS, "Arithmetic error: matrix multiplication");
+        constexpr int RESULTCOLS = CH - CL + 1;
+        FixedMatrix<T, ROWLOW, ROWHIGH, CL, CH> _result;
+        unroll(std::make_index_sequence<ROWS * RESULTCOLS>(), [&](auto index) {
+            constexpr int ROW = decltype(index)::value / RESULTCOLS;
+            constexpr int COL = decltype(index)::value % RESULTCOLS;
+            _result.data[ROW][COL] = dot<ROW, COL>(l_FixedMatrix, std::make_index_sequence<COLS>());
+        });
+        return _result;
+    }
+
+    constexpr FixedMatrix<T, COLLOW, COLHIGH, ROWLOW, ROWHIGH> transpose() const {
+        FixedMatrix<T, COLLOW, COLHIGH, ROWLOW, ROWHIGH> _result;
+        unroll(std::make_index_sequence<ROWS * COLS>(), [&](auto index) {
+            _result.data[index % COLS][index / COLS] = data[index / COLS][index % COLS];
+        });
+        return _result;
+    }
+
+    friend std::ostream & operator<<(std::ostream & l_ostream, const FixedMatrix & l_FixedMatrix) {
+        for (int row = 0; row < ROWS; row++) {
+            for (int col = 0; col < COLS; col++) {
+                l_ostream << l_FixedMatrix.data[row][col] << "\t";
+            }
+            l_ostream << '\n';
+        }
+        return l_ostream;
+    }
+
+private:
+    // call "l_function" with std::integral_constant<std::size_t, I> for every I, fully unrolled
+    template <typename Function, std::size_t... I>
+    static constexpr void unroll(std::index_sequence<I...>, Function && l_function) {
+        (l_function(std::integral_constant<std::size_t, I>()), ...);
+    }
+
+    // sum of products of row ROW of this and column COL of "l_FixedMatrix", fully unrolled
+    template <int ROW, int COL, typename Other, std::size_t... P>
+    constexpr T dot(const Other & l_FixedMatrix, std::index_sequence<P...>) const {
+        return (T() + ... + (data[ROW][P] * l_FixedMatrix.data[P][COL]));
+    }
+
+    // not constexpr, so reaching it during constant evaluation is a compile error
+    static void boundsError(int l_index, int l_low, int l_high) {
+        if (SAFEARRAY_FIXEDMATRIX_DEBUG) {
+            std::cout << "Index selector error: bounds selection " << l_index << " in " << l_low << "-" << l_high
+                      << std::endl;
+        }
+        exit(1);
+    }
+
+    static void constructorError() {
+        if (SAFEARRAY_FIXEDMATRIX_DEBUG) {
+            std::cout << "Constructor error: bounds definition" << std::endl;
+        }
+        exit(1);
+    }
+};
+
+#endif //SAFEARRAY_FIXEDMATRIX_H
@@ -0,0 +1,265 @@
+/*
+ * LU class factors a square SafeMatrix in place as P * A = L * U
+ *
+ * L (unit diagonal) is stored below the diagonal and U on and above it.
+ * Row exchanges swap the row pointers of the SafeMatrix, so no element is copied to pivot.
+ *
+ * Details:
+ *
+ * 1.   Right looking blocked factorization with PANEL columns per step
+ * 2.   Partial pivoting inside the panel
+ * 3.   Trailing update A22 -= L21 * U12 through MatrixKernel::multiplyAdd
+ * 4.   Block row of U and trailing update split across threads for n >= PARALLELSIZE
+ */
+
+#ifndef SAFEARRAY_LU_H
+#define SAFEARRAY_LU_H
+#ifndef SAFEARRAY_LU_DEBUG
+#define SAFEARRAY_LU_DEBUG true
+#endif
+
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "SafeMatrix.h"
+#include "MatrixKernel.h"
+#include "Parallel.h"
+
+template <typename T>
+class LU {
+    static_assert(!std::is_integral<T>::value, "LU requires a field type such as float or double");
+
+private:
+    enum { PANEL = 64, PARALLELSIZE = 256, COLUMNGRAIN = 256 };
+
+    SafeMatrix<T> * lu;
+    // pivot[i] is the row exchanged with row i at step i
+    std::vector<int> pivot;
+    int n;
+    int threads;
+    int swaps = 0;
+    bool singular = false;
+
+public:
+    // factor "l_SafeMatrix" in place, it holds L and U afterwards
+    explicit LU(SafeMatrix<T> & l_SafeMatrix, int l_threads = 0)
+            : lu(& l_SafeMatrix), n(l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1) {
+        if (n != l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1) {
+            if (SAFEARRAY_LU_DEBUG) {
+                std::cout << "Arithmetic error: LU of non square matrix " << n << ","
+                          << l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1 << std::endl;
+            }
+            exit(1);
+        }
+        threads = n >= PARALLELSIZE ? Parallel::threads(l_threads) : 1;
+        pivot.resize(n);
+        factor();
+    }
+
+    bool isSingular() const {
+        return singular;
+    }
+
+    T determinant() const {
+        if (singular) return T();
+        T _product = swaps % 2 ? T(-1) : T(1);
+        for (int i = 0; i < n; i++) {
+            _product *= row(i)[i];
+        }
+        return _product;
+    }
+
+    // x such that A * x = "l_b", x is indexed by the columns of A
+    SafeArray<T> solve(const SafeArray<T> & l_b) const {
+        if (l_b.getHigh() - l_b.getLow() + 1 != n) {
+            if (SAFEARRAY_LU_DEBUG) {
+                std::cout << "Arithmetic error: solve " << n << " " << l_b.getHigh() - l_b.getLow() + 1 << std::endl;
+            }
+            exit(1);
+        }
+        requireRegular();
+        SafeArray<T> x(lu->colLow, lu->colHigh);
+        T * _x = x.data();
+        const T * _b = l_b.data();
+        for (int i = 0; i < n; i++) {
+            _x[i] = _b[i];
+        }
+        for (int i = 0; i < n; i++) {
+            std::swap(_x[i], _x[pivot[i]]);
+        }
+        // forward substitution with unit L
+        for (int i = 1; i < n; i++) {
+            const T * _row = row(i);
+            T _sum = _x[i];
+            for (int p = 0; p < i; p++) {
+                _sum -= _row[p] * _x[p];
+            }
+            _x[i] = _sum;
+        }
+        // backward substitution with U
+        for (int i = n - 1; i >= 0; i--) {
+            const T * _row = row(i);
+            T _sum = _x[i];
+            for (int p = i + 1; p < n; p++) {
+                _sum -= _row[p] * _x[p];
+            }
+            _x[i] = _sum / _row[i];
+        }
+        return x;
+    }
+
+    // X such that A * X = "l_B" for every column of "l_B", X is indexed by the columns of A
+    SafeMatrix<T> solve(const SafeMatrix<T> & l_B) const {
+        if (l_B.rowHigh - l_B.rowLow + 1 != n) {
+            if (SAFEARRAY_LU_DEBUG) {
+                std::cout << "Arithmetic error: solve " << n << " " << l_B.rowHigh - l_B.rowLow + 1 << std::endl;
+            }
+            exit(1);
+        }
+        requireRegular();
+        int cols = l_B.colHigh - l_B.colLow + 1;
+        SafeMatrix<T> X(lu->colLow, lu->colHigh, l_B.colLow, l_B.colHigh);
+
+        // apply the row exchanges while copying "l_B" into X
+        std::vector<int> _order(n);
+        for (int i = 0; i < n; i++) {
+            _order[i] = i;
+        }
+        for (int i = 0; i < n; i++) {
+            std::swap(_order[i], _order[pivot[i]]);
+        }
+        std::vector<T *> _x(n);
+        for (int i = 0; i < n; i++) {
+            _x[i] = X.rows()[i]->data();
+            const T * _b = l_B.matrix[_order[i]]->constData();
+            std::copy(_b, _b + cols, _x[i]);
+        }
+
+        // right hand sides are independent, split them across threads
+        Parallel::forRange(0, cols, n >= PARALLELSIZE ? threads : 1, COLUMNGRAIN, [&](long c0, long c1) {
+            for (int i = 1; i < n; i++) {
+                const T * _row = row(i);
+                for (int p = 0; p < i; p++) {
+                    const T _l = _row[p];
+                    const T * _source = _x[p];
+                    T * _target = _x[i];
+                    for (long c = c0; c < c1; c++) {
+                        _target[c] -= _l * _source[c];
+                    }
+                }
+            }
+            for (int i = n - 1; i >= 0; i--) {
+                const T * _row = row(i);
+                T * _target = _x[i];
+                for (int p = i + 1; p < n; p++) {
+                    const T _u = _row[p];
+                    const T * _source = _x[p];
+                    for (long c = c0; c < c1; c++) {
+                        _target[c] -= _u * _source[c];
+                    }
+                }
+                const T _diagonal = _row[i];
+                for (long c = c0; c < c1; c++) {
+                    _target[c] /= _diagonal;
+                }
+            }
+        });
+        return X;
+    }
+
+    // inverse of A, rows indexed by the columns of A and columns by the rows of A
+    SafeMatrix<T> inverse() const {
+        SafeMatrix<T> _identity(lu->rowLow, lu->rowHigh, lu->rowLow, lu->rowHigh);
+        for (int i = 0; i < n; i++) {
+            _identity.rows()[i]->data()[i] = T(1);
+        }
+        return solve(_identity);
+    }
+
+private:
+    // read only factored row, shared rows of a copied matrix are not copied
+    const T * row(int l_row) const {
+        return lu->matrix[l_row]->constData();
+    }
+
+    void requireRegular() const {
+        if (singular) {
+            if (SAFEARRAY_LU_DEBUG) std::cout << "Arithmetic error: singular matrix" << std::endl;
+            exit(1);
+        }
+    }
+
+    void factor() {
+        // rows are made writable here, before any thread starts
+        SafeArray<T> ** _rows = lu->rows();
+        std::vector<T *> r(n);
+        for (int i = 0; i < n; i++) {
+            r[i] = _rows[i]->data();
+        }
+
+        for (int k0 = 0; k0 < n; k0 += PANEL) {
+            int k1 = std::min(n, k0 + PANEL);
+
+            // factor the panel of columns k0 through k1 - 1
+            for (int j = k0; j < k1; j++) {
+                int _pivot = j;
+                T _largest = std::abs(r[j][j]);
+                for (int i = j + 1; i < n; i++) {
+                    if (std::abs(r[i][j]) > _largest) {
+                        _largest = std::abs(r[i][j]);
+                        _pivot = i;
+                    }
+                }
+                pivot[j] = _pivot;
+                if (_pivot != j) {
+                    std::swap(r[j], r[_pivot]);
+                    std::swap(_rows[j], _rows[_pivot]);
+                    swaps++;
+                }
+                if (r[j][j] == T()) {
+                    singular = true;
+                    continue;
+                }
+                const T * _pivotRow = r[j];
+                for (int i = j + 1; i < n; i++) {
+                    T * _row = r[i];
+                    const T _l = _row[j] /= _pivotRow[j];
+                    for (int c = j + 1; c < k1; c++) {
+                        _row[c] -= _l * _pivotRow[c];
+                    }
+                }
+            }
+            if (k1 == n) break;
+
+            // block row of U, U12 = inverse(L11) * A12
+            Parallel::forRange(k1, n, threads, COLUMNGRAIN, [&](long c0, long c1) {
+                for (int i = k0 + 1; i < k1; i++) {
+                    for (int p = k0; p < i; p++) {
+                        const T _l = r[i][p];
+                        for (long c = c0; c < c1; c++) {
+                            r[i][c] -= _l * r[p][c];
+                        }
+                    }
+                }
+            });
+
+            // trailing update, A22 -= L21 * U12
+            Parallel::forRange(k1, n, threads, PANEL, [&](long i0, long i1) {
+                int _rows = i1 - i0;
+                std::vector<T *> _c(_rows);
+                std::vector<const T *> _a(_rows), _b(k1 - k0);
+                for (int i = 0; i < _rows; i++) {
+                    _c[i] = r[i0 + i] + k1;
+                    _a[i] = r[i0 + i] + k0;
+                }
+                for (int p = 0; p < k1 - k0; p++) {
+                    _b[p] = r[k0 + p] + k1;
+                }
+                MatrixKernel<T>::multiplyAdd(_c.data(), _a.data(), _b.data(), _rows, n - k1, k1 - k0, T(-1));
+            });
+        }
+    }
+};
+
+#endif //SAFEARRAY_LU_H
@@ -0,0 +1,319 @@
+/*
+ * MatrixChain class multiplies a chain of SafeMatrix operands A0 * A1 * ... * An-1 in the cheapest order
+ *
+ * The order is the classic O(n^3) dynamic program over the operand shapes, so a chain of tall and skinny
+ * operands is never evaluated through a large intermediate just because it comes first.
+ *
+ * Details:
+ *
+ * 1.   plan() returns the parenthesization, its cost and the cost of left to right evaluation
+ * 2.   The two halves of every product are independent and run on separate threads,
+ *      threads are shared between the halves in proportion to their cost
+ * 3.   Each product is split by rows across its threads through MatrixKernel::multiplyAdd
+ * 4.   Intermediates live in scratch buffers returned to the chain as soon as their product is done,
+ *      a buffer is reused by any later intermediate that fits, also across calls on the same MatrixChain
+ * 5.   The final product is written straight into the caller's result
+ */
+
+#ifndef SAFEARRAY_MATRIXCHAIN_H
+#define SAFEARRAY_MATRIXCHAIN_H
+#ifndef SAFEARRAY_MATRIXCHAIN_DEBUG
+#define SAFEARRAY_MATRIXCHAIN_DEBUG true
+#endif
+
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SafeMatrix.h"
+#include "MatrixKernel.h"
+#include "Parallel.h"
+
+template <typename T>
+class MatrixChain {
+private:
+    // rows of a product handed to one thread
+    enum { ROWGRAIN = 16 };
+
+public:
+    // optimal order of a chain, found from the shapes only
+    class Plan {
+    private:
+        friend class MatrixChain;
+
+        int count = 0;
+        // operand i is dims[i] by dims[i + 1]
+        std::vector<long> dims;
+        // cheapest product of operands i..j, the last multiplication splits after operand split[i * count + j]
+        std::vector<double> costs;
+        std::vector<int> split;
+
+    public:
+        // scalar multiplications of the planned order
+        double cost() const {
+            return count ? costs[count - 1] : 0;
+        }
+
+        // scalar multiplications of ((A0 * A1) * A2) * ...
+        double leftToRight() const {
+            double _cost = 0;
+            for (int i = 1; i < count; i++) {
+                _cost += (double) dims[0] * dims[i] * dims[i + 1];
+            }
+            return _cost;
+        }
+
+        // parenthesization such as "((A0 A1) A2)"
+        std::string order() const {
+            return count ? order(0, count - 1) : std::string();
+        }
+
+        int splitAfter(int i, int j) const {
+            return split[i * count + j];
+        }
+
+        double cost(int i, int j) const {
+            return costs[i * count + j];
+        }
+
+    private:
+        std::string order(int i, int j) const {
+            if (i == j) return "A" + std::to_string(i);
+            int k = splitAfter(i, j);
+            return "(" + order(i, k) + " " + order(k + 1, j) + ")";
+        }
+    };
+
+private:
+    struct Buffer {
+        std::unique_ptr<T[]> data;
+        std::size_t size = 0;
+        bool busy = false;
+    };
+
+    // rows of an operand or of an intermediate held in "buffer" (nullptr for an operand)
+    struct Product {
+        std::vector<const T *> rows;
+        Buffer * buffer = nullptr;
+    };
+
+    int threads;
+    std::vector<std::unique_ptr<Buffer>> scratch;
+    std::mutex lock;
+
+    // state of the current multiply()
+    SafeMatrix<T> * const * operands = nullptr;
+    Plan current;
+
+public:
+    explicit MatrixChain(int l_threads = 0) : threads(Parallel::threads(l_threads)) { }
+
+    MatrixChain(const MatrixChain &) = delete;
+    MatrixChain & operator=(const MatrixChain &) = delete;
+
+    // optimal parenthesization of "l_count" operands, adjacent shapes must agree
+    static Plan plan(SafeMatrix<T> * const * l_operands, int l_count) {
+        Plan _plan;
+        _plan.count = l_count;
+        _plan.dims.resize(l_count + 1);
+        for (int i = 0; i < l_count; i++) {
+            long _rows = rows(* l_operands[i]);
+            if (i > 0 && _rows != _plan.dims[i]) {
+                if (SAFEARRAY_MATRIXCHAIN_DEBUG) {
+                    std::cout << "Arithmetic error: matrix chain operand " << i << " has " << _rows
+                              << " rows, expected " << _plan.dims[i] << std::endl;
+                }
+                exit(1);
+            }
+            _plan.dims[i] = _rows;
+            _plan.dims[i + 1] = cols(* l_operands[i]);
+        }
+        _plan.costs.assign((std::size_t) l_count * l_count, 0);
+        _plan.split.assign((std::size_t) l_count * l_count, 0);
+        for (int length = 2; length <= l_count; length++) {
+            for (int i = 0; i + length - 1 < l_count; i++) {
+                int j = i + length - 1;
+                double _best = -1;
+                for (int k = i; k < j; k++) {
+                    double _cost = _plan.costs[i * l_count + k] + _plan.costs[(k + 1) * l_count + j]
+                                   + (double) _plan.dims[i] * _plan.dims[k + 1] * _plan.dims[j + 1];
+                    if (_best < 0 || _cost < _best) {
+                        _best = _cost;
+                        _plan.split[i * l_count + j] = k;
+                    }
+                }
+                _plan.costs[i * l_count + j] = _best;
+            }
+        }
+        return _plan;
+    }
+
+    static Plan plan(std::initializer_list<SafeMatrix<T> *> l_operands) {
+        return plan(l_operands.begin(), (int) l_operands.size());
+    }
+
+    // "l_result" = operands[0] * ... * operands[l_count - 1] in the order of plan(), returns that plan
+    Plan multiply(SafeMatrix<T> * const * l_operands, int l_count, SafeMatrix<T> & l_result) {
+        if (l_count < 1) {
+            if (SAFEARRAY_MATRIXCHAIN_DEBUG) {
+                std::cout << "Arithmetic error: empty matrix chain" << std::endl;
+            }
+            exit(1);
+        }
+        current = plan(l_operands, l_count);
+        if (rows(l_result) != current.dims[0] || cols(l_result) != current.dims[l_count]) {
+            if (SAFEARRAY_MATRIXCHAIN_DEBUG) {
+                std::cout << "Arithmetic error: matrix chain result " << rows(l_result) << "," << cols(l_result)
+                          << " " << current.dims[0] << "," << current.dims[l_count] << std::endl;
+            }
+            exit(1);
+        }
+        for (int i = 0; i < l_count; i++) {
+            if (l_operands[i] == & l_result) {
+                if (SAFEARRAY_MATRIXCHAIN_DEBUG) {
+                    std::cout << "Arithmetic error: matrix chain result is operand " << i << std::endl;
+                }
+                exit(1);
+            }
+        }
+        operands = l_operands;
+        std::vector<T *> _result = rowPointers(l_result);
+        if (l_count == 1) {
+            std::vector<const T *> _operand = constRows(* operands[0]);
+            for (long row = 0; row < current.dims[0]; row++) {
+                std::copy(_operand[row], _operand[row] + current.dims[1], _result[row]);
+            }
+        } else {
+            evaluate(0, l_count - 1, threads, _result.data());
+        }
+        operands = nullptr;
+        return current;
+    }
+
+    Plan multiply(std::initializer_list<SafeMatrix<T> *> l_operands, SafeMatrix<T> & l_result) {
+        return multiply(l_operands.begin(), (int) l_operands.size(), l_result);
+    }
+
+    // number and total elements of the scratch buffers kept for later calls
+    int scratchBuffers() const {
+        return scratch.size();
+    }
+
+    std::size_t scratchSize() const {
+        std::size_t _size = 0;
+        for (const std::unique_ptr<Buffer> & buffer : scratch) {
+            _size += buffer->size;
+        }
+        return _size;
+    }
+
+private:
+    static long rows(const SafeMatrix<T> & l_SafeMatrix) {
+        return l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1;
+    }
+
+    static long cols(const SafeMatrix<T> & l_SafeMatrix) {
+        return l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1;
+    }
+
+    // row pointers into the storage of "l_SafeMatrix", bounds are checked once by the caller
+    static std::vector<T *> rowPointers(SafeMatrix<T> & l_SafeMatrix) {
+        std::vector<T *> _rows(rows(l_SafeMatrix));
+        for (std::size_t row = 0; row < _rows.size(); row++) {
+            _rows[row] = l_SafeMatrix.rows()[row]->data();
+        }
+        return _rows;
+    }
+
+    // read only row pointers of an operand, shared rows are not copied
+    static std::vector<const T *> constRows(const SafeMatrix<T> & l_SafeMatrix) {
+        std::vector<const T *> _rows(rows(l_SafeMatrix));
+        for (std::size_t row = 0; row < _rows.size(); row++) {
+            _rows[row] = l_SafeMatrix.matrix[row]->constData();
+        }
+        return _rows;
+    }
+
+    // product of operands "i".."j" into "l_out", a dims[i] by dims[j + 1] block of rows, using "l_threads"
+    void evaluate(int i, int j, int l_threads, T * const * l_out) {
+        int k = current.splitAfter(i, j);
+        Product _left, _right;
+        if (l_threads > 1 && k > i && k + 1 < j) {
+            // both halves are products, run them side by side
+            double _leftCost = current.cost(i, k), _rightCost = current.cost(k + 1, j);
+            int _leftThreads = (int) (l_threads * _leftCost / (_leftCost + _rightCost) + 0.5);
+            _leftThreads = std::min(l_threads - 1, std::max(1, _leftThreads));
+            std::thread _worker([&] { _left = product(i, k, _leftThreads); });
+            _right = product(k + 1, j, l_threads - _leftThreads);
+            _worker.join();
+        } else {
+            _left = product(i, k, l_threads);
+            _right = product(k + 1, j, l_threads);
+        }
+
+        int m = current.dims[i], common = current.dims[k + 1], n = current.dims[j + 1];
+        const T * const * a = _left.rows.data();
+        const T * const * b = _right.rows.data();
+        Parallel::forRange(0, m, l_threads, ROWGRAIN, [&](long l_low, long l_high) {
+            MatrixKernel<T>::clear(l_out + l_low, l_high - l_low, n);
+            MatrixKernel<T>::multiplyAdd(l_out + l_low, a + l_low, b, l_high - l_low, n, common);
+        });
+        release(_left);
+        release(_right);
+    }
+
+    // operand "i" itself when "i" == "j", otherwise their product in a scratch buffer
+    Product product(int i, int j, int l_threads) {
+        Product _product;
+        if (i == j) {
+            _product.rows = constRows(* operands[i]);
+            return _product;
+        }
+        long m = current.dims[i], n = current.dims[j + 1];
+        _product.buffer = acquire((std::size_t) m * n);
+        T * _data = _product.buffer->data.get();
+        std::vector<T *> _rows(m);
+        for (long row = 0; row < m; row++) {
+            _rows[row] = _data + row * n;
+        }
+        evaluate(i, j, l_threads, _rows.data());
+        _product.rows.assign(_rows.begin(), _rows.end());
+        return _product;
+    }
+
+    // smallest free buffer of at least "l_size" elements, a new one if none is free
+    Buffer * acquire(std::size_t l_size) {
+        std::lock_guard<std::mutex> _guard(lock);
+        int _best = -1;
+        for (std::size_t index = 0; index < scratch.size(); index++) {
+            if (!scratch[index]->busy && scratch[index]->size >= l_size
+                && (_best < 0 || scratch[index]->size < scratch[_best]->size))
+                _best = index;
+        }
+        if (_best < 0) {
+            // grow the largest free buffer rather than keep one that is too small
+            for (std::size_t index = 0; index < scratch.size(); index++) {
+                if (!scratch[index]->busy && (_best < 0 || scratch[index]->size > scratch[_best]->size))
+                    _best = index;
+            }
+            if (_best < 0) {
+                scratch.emplace_back(new Buffer());
+                _best = scratch.size() - 1;
+            }
+            scratch[_best]->data.reset(new T[l_size]);
+            scratch[_best]->size = l_size;
+        }
+        scratch[_best]->busy = true;
+        return scratch[_best].get();
+    }
+
+    void release(const Product & l_product) {
+        if (!l_product.buffer) return;
+        std::lock_guard<std::mutex> _guard(lock);
+        l_product.buffer->busy = false;
+    }
+};
+
+#endif //SAFEARRAY_MATRIXCHAIN_H
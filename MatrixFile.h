@@ -0,0 +1,348 @@
+/*
+ * MatrixFile class stores a SafeMatrix in a compact binary file and maps it back into memory
+ *
+ * File layout:
+ * 1.   Header      64 bytes holding type, bounds, layout and checksums
+ * 2.   Payload     row major elements starting at DATAOFFSET (page aligned)
+ *
+ * Mapping modes:
+ * READONLY     shared read only mapping, zero-copy, only the const matrix() is available
+ * COPYONWRITE  private mapping, written pages are copied in memory and never reach the file,
+ *              writableMatrix() gives the matrix to write through
+ *
+ * The header checksum is always verified when mapping.
+ * The payload checksum touches every page, so it is only verified on request.
+ */
+
+#ifndef SAFEARRAY_MATRIXFILE_H
+#define SAFEARRAY_MATRIXFILE_H
+#ifndef SAFEARRAY_MATRIXFILE_DEBUG
+#define SAFEARRAY_MATRIXFILE_DEBUG true
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SafeMatrix.h"
+
+// element type codes stored in the header, code 0 is any other type and only its size is checked
+template <typename T> struct MatrixType { enum { CODE = 0 }; };
+template <> struct MatrixType<int8_t> { enum { CODE = 1 }; };
+template <> struct MatrixType<uint8_t> { enum { CODE = 2 }; };
+template <> struct MatrixType<int16_t> { enum { CODE = 3 }; };
+template <> struct MatrixType<uint16_t> { enum { CODE = 4 }; };
+template <> struct MatrixType<int32_t> { enum { CODE = 5 }; };
+template <> struct MatrixType<uint32_t> { enum { CODE = 6 }; };
+template <> struct MatrixType<int64_t> { enum { CODE = 7 }; };
+template <> struct MatrixType<uint64_t> { enum { CODE = 8 }; };
+template <> struct MatrixType<float> { enum { CODE = 9 }; };
+template <> struct MatrixType<double> { enum { CODE = 10 }; };
+
+template <typename T>
+class MatrixFile {
+    static_assert(std::is_trivially_copyable<T>::value, "MatrixFile elements must be trivially copyable");
+
+public:
+    enum Mode { READONLY, COPYONWRITE };
+
+    // bounds and payload position of a row major matrix file
+    struct Layout {
+        int rowLow, rowHigh, colLow, colHigh;
+        uint64_t dataOffset;
+    };
+
+private:
+    // information located at the start of the file using 64 bytes
+    struct Header {
+        char MAGIC[4];
+        uint16_t VERSION;
+        uint8_t TYPE;
+        uint8_t LAYOUT;
+        uint32_t ELEMSIZE;
+        int32_t ROWLOW, ROWHIGH, COLLOW, COLHIGH;
+        uint32_t RESERVED;
+        uint64_t DATAOFFSET;
+        uint64_t DATASIZE;
+        uint64_t DATACHECKSUM;
+        // checksum of every header byte before this field
+        uint64_t HEADCHECKSUM;
+    };
+    static_assert(sizeof(Header) == 64, "MatrixFile header must be 64 bytes");
+
+    enum { VERSION = 1, ROWMAJOR = 0, ALIGNMENT = 4096 };
+
+    void * mapping = nullptr;
+    std::size_t mappingSize = 0;
+    SafeMatrix<T> * view = nullptr;
+    Mode mode;
+
+public:
+    // map the file at "l_path" and view it as a SafeMatrix
+    explicit MatrixFile(const std::string & l_path, Mode l_mode = READONLY, bool l_verify = false) : mode(l_mode) {
+        int _fd = ::open(l_path.c_str(), O_RDONLY);
+        if (_fd < 0) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: open " << l_path << std::endl;
+            return;
+        }
+        struct stat _stat;
+        if (fstat(_fd, & _stat) != 0 || (std::size_t) _stat.st_size < sizeof(Header)) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: truncated header " << l_path << std::endl;
+            ::close(_fd);
+            return;
+        }
+        mappingSize = _stat.st_size;
+        int _prot = l_mode == READONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+        int _flags = l_mode == READONLY ? MAP_SHARED : MAP_PRIVATE;
+        mapping = mmap(nullptr, mappingSize, _prot, _flags, _fd, 0);
+        // the mapping keeps its own reference to the file
+        ::close(_fd);
+        if (mapping == MAP_FAILED) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: mmap " << l_path << std::endl;
+            mapping = nullptr;
+            return;
+        }
+
+        const Header * _head = reinterpret_cast<const Header *>(mapping);
+        if (!validHeader(* _head, mappingSize)) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: invalid header " << l_path << std::endl;
+            release();
+            return;
+        }
+
+        T * _data = reinterpret_cast<T *>(reinterpret_cast<char *>(mapping) + _head->DATAOFFSET);
+        if (l_verify && payloadChecksum(_data, extent(_head->ROWLOW, _head->ROWHIGH),
+                                        extent(_head->COLLOW, _head->COLHIGH)) != _head->DATACHECKSUM) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: payload checksum " << l_path << std::endl;
+            release();
+            return;
+        }
+
+        // sequential access is the common case for loading, let the kernel read ahead
+        madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+        view = new SafeMatrix<T>(_data, _head->ROWLOW, _head->ROWHIGH, _head->COLLOW, _head->COLHIGH);
+    }
+
+    MatrixFile(const MatrixFile<T> &) = delete;
+    MatrixFile<T> & operator=(const MatrixFile<T> &) = delete;
+
+    ~MatrixFile() { release(); }
+
+    // true if the file was mapped and passed validation
+    bool isOpen() const {
+        return view != nullptr;
+    }
+
+    // matrix viewing the mapped payload, only valid while the MatrixFile is alive
+    const SafeMatrix<T> & matrix() const {
+        if (!view) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: matrix of unopened file" << std::endl;
+            exit(1);
+        }
+        return * view;
+    }
+
+    // the same matrix for writing, a READONLY mapping would fault on the first write
+    SafeMatrix<T> & writableMatrix() {
+        if (mode == READONLY) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: writable matrix of read only file" << std::endl;
+            exit(1);
+        }
+        matrix();
+        return * view;
+    }
+
+    // write "l_SafeMatrix" to "l_path", returns false on failure
+    static bool write(const std::string & l_path, const SafeMatrix<T> & l_SafeMatrix) {
+        int rows = l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1;
+        int cols = l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1;
+
+        Header _head = makeHeader(l_SafeMatrix.rowLow, l_SafeMatrix.rowHigh,
+                                  l_SafeMatrix.colLow, l_SafeMatrix.colHigh);
+        uint64_t _sum = 0;
+        for (int row = 0; row < rows; row++) {
+            _sum = checksum(l_SafeMatrix.matrix[row]->constData(), cols * sizeof(T), _sum);
+        }
+        _head.DATACHECKSUM = _sum;
+        _head.HEADCHECKSUM = checksum(& _head, offsetof(Header, HEADCHECKSUM), 0);
+
+        std::ofstream _out(l_path, std::ios::binary | std::ios::trunc);
+        if (!_out) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: open " << l_path << std::endl;
+            return false;
+        }
+        _out.write(reinterpret_cast<const char *>(& _head), sizeof(Header));
+        static const char _padding[ALIGNMENT] = {};
+        _out.write(_padding, _head.DATAOFFSET - sizeof(Header));
+        for (int row = 0; row < rows; row++) {
+            _out.write(reinterpret_cast<const char *>(l_SafeMatrix.matrix[row]->constData()), cols * sizeof(T));
+        }
+        _out.close();
+        if (!_out) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: write " << l_path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // create a zero filled file for a matrix that is written piece by piece, call seal() when finished
+    static bool create(const std::string & l_path, int l_rowLow, int l_rowHigh, int l_colLow, int l_colHigh) {
+        if (extent(l_rowLow, l_rowHigh) < 1 || extent(l_colLow, l_colHigh) < 1) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: bounds definition " << l_path << std::endl;
+            return false;
+        }
+        Header _head = makeHeader(l_rowLow, l_rowHigh, l_colLow, l_colHigh);
+        _head.HEADCHECKSUM = checksum(& _head, offsetof(Header, HEADCHECKSUM), 0);
+        int _fd = ::open(l_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool _success = _fd >= 0
+                        && pwrite(_fd, & _head, sizeof(Header), 0) == (ssize_t) sizeof(Header)
+                        && ftruncate(_fd, _head.DATAOFFSET + _head.DATASIZE) == 0;
+        if (_fd >= 0)
+            ::close(_fd);
+        if (!_success && SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: create " << l_path << std::endl;
+        return _success;
+    }
+
+    // recompute the payload checksum of a file filled in after create()
+    static bool seal(const std::string & l_path) {
+        Layout _layout;
+        if (!layout(l_path, _layout)) return false;
+        int _fd = ::open(l_path.c_str(), O_RDWR);
+        if (_fd < 0) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: open " << l_path << std::endl;
+            return false;
+        }
+        Header _head;
+        bool _success = pread(_fd, & _head, sizeof(Header), 0) == (ssize_t) sizeof(Header);
+        void * _mapping = _success ? mmap(nullptr, _head.DATAOFFSET + _head.DATASIZE, PROT_READ, MAP_SHARED, _fd, 0)
+                                   : MAP_FAILED;
+        if (_mapping != MAP_FAILED) {
+            madvise(_mapping, _head.DATAOFFSET + _head.DATASIZE, MADV_SEQUENTIAL);
+            _head.DATACHECKSUM = payloadChecksum(reinterpret_cast<const T *>(
+                                                         reinterpret_cast<char *>(_mapping) + _head.DATAOFFSET),
+                                                 extent(_layout.rowLow, _layout.rowHigh),
+                                                 extent(_layout.colLow, _layout.colHigh));
+            munmap(_mapping, _head.DATAOFFSET + _head.DATASIZE);
+            _head.HEADCHECKSUM = checksum(& _head, offsetof(Header, HEADCHECKSUM), 0);
+            _success = pwrite(_fd, & _head, sizeof(Header), 0) == (ssize_t) sizeof(Header);
+        } else {
+            _success = false;
+        }
+        ::close(_fd);
+        if (!_success && SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: seal " << l_path << std::endl;
+        return _success;
+    }
+
+    // read bounds and payload offset of a file without mapping it, for callers doing their own I/O
+    static bool layout(const std::string & l_path, Layout & l_layout) {
+        Header _head;
+        struct stat _stat;
+        int _fd = ::open(l_path.c_str(), O_RDONLY);
+        bool _success = _fd >= 0
+                        && fstat(_fd, & _stat) == 0
+                        && pread(_fd, & _head, sizeof(Header), 0) == (ssize_t) sizeof(Header)
+                        && validHeader(_head, _stat.st_size);
+        if (_fd >= 0)
+            ::close(_fd);
+        if (!_success) {
+            if (SAFEARRAY_MATRIXFILE_DEBUG) std::cout << "File error: invalid header " << l_path << std::endl;
+            return false;
+        }
+        l_layout.rowLow = _head.ROWLOW;
+        l_layout.rowHigh = _head.ROWHIGH;
+        l_layout.colLow = _head.COLLOW;
+        l_layout.colHigh = _head.COLHIGH;
+        l_layout.dataOffset = _head.DATAOFFSET;
+        return true;
+    }
+
+    // 64 bit checksum over 4 independent lanes so it runs at memory speed, chained through "l_seed"
+    static uint64_t checksum(const void * l_data, std::size_t l_size, uint64_t l_seed) {
+        const uint64_t PRIME = 0x100000001b3ULL;
+        uint64_t _lane[4] = { l_seed ^ 0xcbf29ce484222325ULL, l_seed + 1, l_seed + 2, l_seed + 3 };
+        const unsigned char * _byte = reinterpret_cast<const unsigned char *>(l_data);
+        std::size_t _index = 0;
+        for (; _index + 32 <= l_size; _index += 32) {
+            for (int lane = 0; lane < 4; lane++) {
+                uint64_t _word;
+                std::memcpy(& _word, _byte + _index + lane * 8, 8);
+                _lane[lane] = (_lane[lane] ^ _word) * PRIME;
+            }
+        }
+        uint64_t _hash = _lane[0] ^ (_lane[1] << 1) ^ (_lane[2] << 2) ^ (_lane[3] << 3);
+        for (; _index < l_size; _index++) {
+            _hash = (_hash ^ _byte[_index]) * PRIME;
+        }
+        return _hash ^ l_size;
+    }
+
+private:
+    static Header makeHeader(int l_rowLow, int l_rowHigh, int l_colLow, int l_colHigh) {
+        Header _head;
+        std::memset(& _head, 0, sizeof(Header));
+        std::memcpy(_head.MAGIC, "SMAT", 4);
+        _head.VERSION = VERSION;
+        _head.TYPE = MatrixType<T>::CODE;
+        _head.LAYOUT = ROWMAJOR;
+        _head.ELEMSIZE = sizeof(T);
+        _head.ROWLOW = l_rowLow;
+        _head.ROWHIGH = l_rowHigh;
+        _head.COLLOW = l_colLow;
+        _head.COLHIGH = l_colHigh;
+        _head.DATAOFFSET = ALIGNMENT;
+        _head.DATASIZE = (uint64_t) extent(l_rowLow, l_rowHigh) * extent(l_colLow, l_colHigh) * sizeof(T);
+        return _head;
+    }
+
+    static bool validHeader(const Header & l_head, std::size_t l_fileSize) {
+        return std::memcmp(l_head.MAGIC, "SMAT", 4) == 0
+               && l_head.HEADCHECKSUM == checksum(& l_head, offsetof(Header, HEADCHECKSUM), 0)
+               && l_head.VERSION == VERSION
+               && l_head.TYPE == MatrixType<T>::CODE
+               && l_head.ELEMSIZE == sizeof(T)
+               && l_head.LAYOUT == ROWMAJOR
+               && l_head.ROWHIGH >= l_head.ROWLOW && l_head.COLHIGH >= l_head.COLLOW
+               // a SafeMatrix counts its rows and columns in int
+               && extent(l_head.ROWLOW, l_head.ROWHIGH) <= INT32_MAX
+               && extent(l_head.COLLOW, l_head.COLHIGH) <= INT32_MAX
+               && l_head.DATAOFFSET % alignof(T) == 0
+               // compared without sums or products that can wrap around
+               && l_head.DATAOFFSET <= l_fileSize
+               && l_head.DATASIZE <= l_fileSize - l_head.DATAOFFSET
+               && (uint64_t) extent(l_head.ROWLOW, l_head.ROWHIGH) * extent(l_head.COLLOW, l_head.COLHIGH)
+                  <= (l_fileSize - l_head.DATAOFFSET) / sizeof(T)
+               && l_head.DATASIZE == (uint64_t) extent(l_head.ROWLOW, l_head.ROWHIGH)
+                                     * extent(l_head.COLLOW, l_head.COLHIGH) * sizeof(T);
+    }
+
+    // rows or columns between two bounds, in 64 bits since the bounds come from the file
+    static int64_t extent(int32_t l_low, int32_t l_high) {
+        return (int64_t) l_high - l_low + 1;
+    }
+
+    static uint64_t payloadChecksum(const T * l_data, int64_t l_rows, int64_t l_cols) {
+        // chained row by row to match write()
+        uint64_t _sum = 0;
+        for (int64_t row = 0; row < l_rows; row++) {
+            _sum = checksum(l_data + (std::size_t) row * l_cols, l_cols * sizeof(T), _sum);
+        }
+        return _sum;
+    }
+
+    void release() {
+        delete view;
+        view = nullptr;
+        if (mapping)
+            munmap(mapping, mappingSize);
+        mapping = nullptr;
+    }
+};
+
+#endif //SAFEARRAY_MATRIXFILE_H
@@ -0,0 +1,58 @@
+/*
+ * MatrixKernel class holds the unchecked inner loops shared by the matrix algorithms
+ *
+ * Kernels work on arrays of row pointers, so any rectangular piece of a SafeMatrix
+ * (or of a plain row major buffer) can be passed by offsetting the row pointers.
+ * Bounds are checked once by the caller, never per element.
+ *
+ * Details:
+ *
+ * 1.   i-p-j loop order so the innermost loop streams both b and c rows (vectorizable)
+ * 2.   Cache blocking over the common dimension and the columns of c
+ */
+
+#ifndef SAFEARRAY_MATRIXKERNEL_H
+#define SAFEARRAY_MATRIXKERNEL_H
+
+#include <algorithm>
+#include "Trace.h"
+
+template <typename T>
+class MatrixKernel {
+private:
+    // block sizes in elements, a KBLOCK x NBLOCK piece of b stays in cache
+    enum { KBLOCK = 128, NBLOCK = 512 };
+
+public:
+    // c[i][j] += alpha * sum of a[i][p] * b[p][j] for an "m" by "k" a and a "k" by "n" b
+    static void multiplyAdd(T * const * c, const T * const * a, const T * const * b,
+                            int m, int n, int k, T alpha = T(1)) {
+        Trace::Scope _trace(Trace::KERNEL_MULTIPLY, m, n, k);
+        for (int p0 = 0; p0 < k; p0 += KBLOCK) {
+            int p1 = std::min(k, p0 + KBLOCK);
+            for (int j0 = 0; j0 < n; j0 += NBLOCK) {
+                int j1 = std::min(n, j0 + NBLOCK);
+                for (int i = 0; i < m; i++) {
+                    T * _c = c[i];
+                    const T * _a = a[i];
+                    for (int p = p0; p < p1; p++) {
+                        const T _aip = alpha * _a[p];
+                        const T * _b = b[p];
+                        for (int j = j0; j < j1; j++) {
+                            _c[j] += _aip * _b[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // c[i][j] = 0 for an "m" by "n" c
+    static void clear(T * const * c, int m, int n) {
+        for (int i = 0; i < m; i++) {
+            std::fill(c[i], c[i] + n, T());
+        }
+    }
+};
+
+#endif //SAFEARRAY_MATRIXKERNEL_H
@@ -0,0 +1,250 @@
+/*
+ * OutOfCore class multiplies MatrixFile operands that do not fit in memory
+ *
+ * c = a * b is computed one t x t tile of c at a time, streaming the matching tiles of a and b
+ * from disk and writing each finished tile of c back to its file.
+ *
+ * Details:
+ *
+ * 1.   Tile size chosen from a memory budget, 6 tiles are resident (2 of a, 2 of b, 2 of c)
+ * 2.   Double buffered reads, the tiles for step s + 1 load while step s computes
+ * 3.   Double buffered writes, a finished tile of c is written while the next one computes
+ * 4.   Tiles are SafeMatrix views over the buffers, indexed with the global bounds of the operands
+ * 5.   Time spent reading, writing, computing and waiting on I/O is reported through Stats
+ */
+
+#ifndef SAFEARRAY_OUTOFCORE_H
+#define SAFEARRAY_OUTOFCORE_H
+#ifndef SAFEARRAY_OUTOFCORE_DEBUG
+#define SAFEARRAY_OUTOFCORE_DEBUG true
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <memory>
+#include <vector>
+#include "MatrixFile.h"
+#include "MatrixKernel.h"
+
+template <typename T>
+class OutOfCore {
+public:
+    struct Stats {
+        int tileSize = 0;
+        std::size_t bytesRead = 0;
+        std::size_t bytesWritten = 0;
+        double readSeconds = 0;     // time spent inside reads, overlapped with compute
+        double writeSeconds = 0;    // time spent inside writes, overlapped with compute
+        double computeSeconds = 0;  // time spent in the multiply kernel
+        double stallSeconds = 0;    // time compute waited for I/O to finish
+        double totalSeconds = 0;
+    };
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    typedef typename MatrixFile<T>::Layout Layout;
+
+    // result of one background read or write
+    struct Transfer {
+        bool success;
+        std::size_t bytes;
+        double seconds;
+    };
+
+    // position of a rectangular tile inside a matrix file
+    struct Tile {
+        int row, rows, col, cols;
+    };
+
+public:
+    // c = a * b for the files at "l_a" and "l_b" keeping roughly "l_budget" bytes of tiles resident
+    static bool multiply(const std::string & l_a, const std::string & l_b, const std::string & l_c,
+                         std::size_t l_budget, Stats * l_stats = nullptr) {
+        Clock::time_point _start = Clock::now();
+        Stats _stats;
+
+        Layout _a, _b;
+        if (!MatrixFile<T>::layout(l_a, _a) || !MatrixFile<T>::layout(l_b, _b)) return false;
+        int m = _a.rowHigh - _a.rowLow + 1;
+        int k = _a.colHigh - _a.colLow + 1;
+        int n = _b.colHigh - _b.colLow + 1;
+
+        // SafeMatrix a(x,m) = b(x,y) * c(m,n) if and only if y = m
+        if (k != _b.rowHigh - _b.rowLow + 1) {
+            if (SAFEARRAY_OUTOFCORE_DEBUG) {
+                std::cout << "Arithmetic error: matrix multiplication " << k << " "
+                          << _b.rowHigh - _b.rowLow + 1 << std::endl;
+            }
+            return false;
+        }
+        if (!MatrixFile<T>::create(l_c, _a.rowLow, _a.rowHigh, _b.colLow, _b.colHigh)) return false;
+        Layout _c;
+        if (!MatrixFile<T>::layout(l_c, _c)) return false;
+
+        int t = tileSize(l_budget, std::max(m, std::max(n, k)));
+        _stats.tileSize = t;
+
+        int _fdA = ::open(l_a.c_str(), O_RDONLY);
+        int _fdB = ::open(l_b.c_str(), O_RDONLY);
+        int _fdC = ::open(l_c.c_str(), O_WRONLY);
+        if (_fdA < 0 || _fdB < 0 || _fdC < 0) {
+            if (SAFEARRAY_OUTOFCORE_DEBUG) std::cout << "File error: open operands" << std::endl;
+            closeAll(_fdA, _fdB, _fdC);
+            return false;
+        }
+
+        // the operands are read tile by tile in a predictable order
+        posix_fadvise(_fdA, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(_fdB, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        std::size_t _tileElements = (std::size_t) t * t;
+        std::unique_ptr<T[]> _aBuffer[2], _bBuffer[2], _cBuffer[2];
+        for (int slot = 0; slot < 2; slot++) {
+            _aBuffer[slot].reset(new T[_tileElements]);
+            _bBuffer[slot].reset(new T[_tileElements]);
+            _cBuffer[slot].reset(new T[_tileElements]);
+        }
+
+        int _rowTiles = (m + t - 1) / t;
+        int _colTiles = (n + t - 1) / t;
+        int _innerTiles = (k + t - 1) / t;
+        long _steps = (long) _rowTiles * _colTiles * _innerTiles;
+
+        // step s multiplies tile (I, P) of a with tile (P, J) of b into tile (I, J) of c
+        auto tilesOf = [&](long s, Tile & l_aTile, Tile & l_bTile, Tile & l_cTile) {
+            int _p = s % _innerTiles;
+            int _j = (s / _innerTiles) % _colTiles;
+            int _i = s / ((long) _innerTiles * _colTiles);
+            l_aTile = { _i * t, std::min(t, m - _i * t), _p * t, std::min(t, k - _p * t) };
+            l_bTile = { _p * t, std::min(t, k - _p * t), _j * t, std::min(t, n - _j * t) };
+            l_cTile = { _i * t, std::min(t, m - _i * t), _j * t, std::min(t, n - _j * t) };
+        };
+        auto readStep = [&](long s, int l_slot) {
+            Tile _aTile, _bTile, _cTile;
+            tilesOf(s, _aTile, _bTile, _cTile);
+            Transfer _first = transfer(_fdA, _a, _aTile, _aBuffer[l_slot].get(), false);
+            Transfer _second = transfer(_fdB, _b, _bTile, _bBuffer[l_slot].get(), false);
+            return Transfer{ _first.success && _second.success, _first.bytes + _second.bytes,
+                             _first.seconds + _second.seconds };
+        };
+
+        bool _success = true;
+        int _cSlot = 0;
+        std::future<Transfer> _read = std::async(std::launch::async, readStep, 0L, 0);
+        std::future<Transfer> _write;
+        std::vector<T *> _aRows, _bRows, _cRows;
+
+        for (long s = 0; s < _steps && _success; s++) {
+            int _slot = s % 2;
+            _success = collect(_read, _stats.bytesRead, _stats.readSeconds, _stats.stallSeconds);
+            if (s + 1 < _steps)
+                _read = std::async(std::launch::async, readStep, s + 1, 1 - _slot);
+
+            Tile _aTile, _bTile, _cTile;
+            tilesOf(s, _aTile, _bTile, _cTile);
+            Clock::time_point _computeStart = Clock::now();
+
+            // views carry the global bounds of the operands so tiles index like the full matrices
+            SafeMatrix<T> _aView(_aBuffer[_slot].get(), _a.rowLow + _aTile.row, _a.rowLow + _aTile.row + _aTile.rows - 1,
+                                 _a.colLow + _aTile.col, _a.colLow + _aTile.col + _aTile.cols - 1);
+            SafeMatrix<T> _bView(_bBuffer[_slot].get(), _b.rowLow + _bTile.row, _b.rowLow + _bTile.row + _bTile.rows - 1,
+                                 _b.colLow + _bTile.col, _b.colLow + _bTile.col + _bTile.cols - 1);
+            SafeMatrix<T> _cView(_cBuffer[_cSlot].get(), _c.rowLow + _cTile.row, _c.rowLow + _cTile.row + _cTile.rows - 1,
+                                 _c.colLow + _cTile.col, _c.colLow + _cTile.col + _cTile.cols - 1);
+            rowPointers(_aView, _aRows);
+            rowPointers(_bView, _bRows);
+            rowPointers(_cView, _cRows);
+
+            if (_aTile.col == 0)
+                MatrixKernel<T>::clear(_cRows.data(), _cTile.rows, _cTile.cols);
+            MatrixKernel<T>::multiplyAdd(_cRows.data(), _aRows.data(), _bRows.data(),
+                                         _cTile.rows, _cTile.cols, _aTile.cols);
+            _stats.computeSeconds += seconds(_computeStart, Clock::now());
+
+            // tile of c is complete after the last inner step
+            if (_aTile.col + _aTile.cols == k) {
+                if (_write.valid())
+                    _success = collect(_write, _stats.bytesWritten, _stats.writeSeconds, _stats.stallSeconds)
+                               && _success;
+                T * _buffer = _cBuffer[_cSlot].get();
+                _write = std::async(std::launch::async, [&, _cTile, _buffer]() {
+                    return transfer(_fdC, _c, _cTile, _buffer, true);
+                });
+                _cSlot = 1 - _cSlot;
+            }
+        }
+        if (_read.valid())
+            _read.wait();
+        if (_write.valid())
+            _success = collect(_write, _stats.bytesWritten, _stats.writeSeconds, _stats.stallSeconds) && _success;
+        closeAll(_fdA, _fdB, _fdC);
+
+        _success = _success && MatrixFile<T>::seal(l_c);
+        _stats.totalSeconds = seconds(_start, Clock::now());
+        if (l_stats)
+            * l_stats = _stats;
+        if (!_success && SAFEARRAY_OUTOFCORE_DEBUG) std::cout << "File error: out of core multiply" << std::endl;
+        return _success;
+    }
+
+private:
+    // largest square tile such that 6 tiles fit in "l_budget" bytes
+    static int tileSize(std::size_t l_budget, int l_largest) {
+        int t = (int) std::sqrt((double) l_budget / (6.0 * sizeof(T)));
+        return std::max(1, std::min(t, l_largest));
+    }
+
+    // read or write "l_tile" of the file as a dense row major buffer of l_tile.cols columns
+    static Transfer transfer(int l_fd, const Layout & l_layout, const Tile & l_tile, T * l_buffer, bool l_write) {
+        Clock::time_point _start = Clock::now();
+        std::size_t _fileCols = l_layout.colHigh - l_layout.colLow + 1;
+        std::size_t _rowBytes = l_tile.cols * sizeof(T);
+        bool _success = true;
+        for (int row = 0; row < l_tile.rows && _success; row++) {
+            off_t _offset = l_layout.dataOffset + ((l_tile.row + row) * _fileCols + l_tile.col) * sizeof(T);
+            char * _bytes = reinterpret_cast<char *>(l_buffer + (std::size_t) row * l_tile.cols);
+            std::size_t _done = 0;
+            while (_done < _rowBytes) {
+                ssize_t _count = l_write ? pwrite(l_fd, _bytes + _done, _rowBytes - _done, _offset + _done)
+                                         : pread(l_fd, _bytes + _done, _rowBytes - _done, _offset + _done);
+                if (_count <= 0) {
+                    _success = false;
+                    break;
+                }
+                _done += _count;
+            }
+        }
+        return Transfer{ _success, _rowBytes * l_tile.rows, seconds(_start, Clock::now()) };
+    }
+
+    // wait for a background transfer and add its cost to the statistics
+    static bool collect(std::future<Transfer> & l_future, std::size_t & l_bytes, double & l_seconds, double & l_stall) {
+        Clock::time_point _start = Clock::now();
+        Transfer _transfer = l_future.get();
+        l_stall += seconds(_start, Clock::now());
+        l_bytes += _transfer.bytes;
+        l_seconds += _transfer.seconds;
+        return _transfer.success;
+    }
+
+    static void rowPointers(SafeMatrix<T> & l_SafeMatrix, std::vector<T *> & l_rows) {
+        int rows = l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1;
+        l_rows.resize(rows);
+        for (int row = 0; row < rows; row++) {
+            l_rows[row] = l_SafeMatrix.rows()[row]->data();
+        }
+    }
+
+    static double seconds(Clock::time_point l_start, Clock::time_point l_end) {
+        return std::chrono::duration<double>(l_end - l_start).count();
+    }
+
+    static void closeAll(int l_a, int l_b, int l_c) {
+        if (l_a >= 0) ::close(l_a);
+        if (l_b >= 0) ::close(l_b);
+        if (l_c >= 0) ::close(l_c);
+    }
+};
+
+#endif //SAFEARRAY_OUTOFCORE_H
@@ -0,0 +1,126 @@
+/*
+ * Parallel class splits an index range into contiguous chunks run on a pool of worker threads
+ *
+ * Details:
+ *
+ * 1.   Workers start on first use and wait for work between calls, they are kept for the life of the program
+ *      like Block arenas, so a call costs a wake up instead of a thread start per chunk
+ * 2.   The pool grows to the largest number of threads any call asked for
+ * 3.   The calling thread claims chunks like the workers do, so a single chunk never wakes a worker
+ *      and a call made from inside a chunk finishes even when every worker is busy
+ * 4.   Chunk bounds depend on the range, the grain and the thread count only, not on which thread runs them
+ */
+
+#ifndef SAFEARRAY_PARALLEL_H
+#define SAFEARRAY_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class Parallel {
+private:
+    // one forRange call, its chunks are claimed by the caller and by every worker that picks it up
+    struct Batch {
+        void (* call)(void *, long, long);
+        void * function;
+        long begin, count, chunks;
+        std::atomic<long> next{ 0 };
+        // workers inside run(), guarded by the pool lock
+        int users = 0;
+    };
+
+    struct Pool {
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable finished;
+        std::deque<Batch *> queue;
+        int workers = 0;
+    };
+
+public:
+    // number of threads to use when the caller passes 0
+    static int threads(int l_threads = 0) {
+        if (l_threads > 0) return l_threads;
+        int _hardware = (int) std::thread::hardware_concurrency();
+        return _hardware > 0 ? _hardware : 1;
+    }
+
+    // call "l_function(begin, end)" on at most "l_threads" chunks of [l_begin, l_end)
+    // chunks hold at least "l_grain" indices
+    template <typename Function>
+    static void forRange(long l_begin, long l_end, int l_threads, long l_grain, Function l_function) {
+        long _count = l_end - l_begin;
+        if (_count <= 0) return;
+        long _chunks = std::min<long>(threads(l_threads), std::max<long>(1, _count / std::max<long>(1, l_grain)));
+        if (_chunks == 1) {
+            l_function(l_begin, l_end);
+            return;
+        }
+        Batch _batch;
+        _batch.call = [](void * l_function, long l_low, long l_high) {
+            (* static_cast<Function *>(l_function))(l_low, l_high);
+        };
+        _batch.function = & l_function;
+        _batch.begin = l_begin;
+        _batch.count = _count;
+        _batch.chunks = _chunks;
+
+        Pool & _pool = pool();
+        {
+            std::lock_guard<std::mutex> _guard(_pool.lock);
+            for (; _pool.workers < _chunks - 1; _pool.workers++) {
+                std::thread(work).detach();
+            }
+            _pool.queue.push_back(& _batch);
+        }
+        _pool.wake.notify_all();
+        run(_batch);
+
+        // every chunk is claimed, wait for the workers still running one
+        std::unique_lock<std::mutex> _guard(_pool.lock);
+        remove(_pool, & _batch);
+        _pool.finished.wait(_guard, [&] { return _batch.users == 0; });
+    }
+
+private:
+    static Pool & pool() {
+        static Pool * _pool = new Pool();
+        return * _pool;
+    }
+
+    // run unclaimed chunks of "l_batch" until none is left
+    static void run(Batch & l_batch) {
+        for (long chunk = l_batch.next.fetch_add(1, std::memory_order_relaxed); chunk < l_batch.chunks;
+             chunk = l_batch.next.fetch_add(1, std::memory_order_relaxed)) {
+            l_batch.call(l_batch.function, l_batch.begin + l_batch.count * chunk / l_batch.chunks,
+                         l_batch.begin + l_batch.count * (chunk + 1) / l_batch.chunks);
+        }
+    }
+
+    static void remove(Pool & l_pool, Batch * l_batch) {
+        std::deque<Batch *>::iterator _found = std::find(l_pool.queue.begin(), l_pool.queue.end(), l_batch);
+        if (_found != l_pool.queue.end()) l_pool.queue.erase(_found);
+    }
+
+    // worker loop, "l_batch" is only touched while its caller waits for "users" to drop to 0
+    static void work() {
+        Pool & _pool = pool();
+        std::unique_lock<std::mutex> _guard(_pool.lock);
+        while (true) {
+            _pool.wake.wait(_guard, [&] { return !_pool.queue.empty(); });
+            Batch * _batch = _pool.queue.front();
+            _batch->users++;
+            _guard.unlock();
+            run(* _batch);
+            _guard.lock();
+            remove(_pool, _batch);
+            if (--_batch->users == 0) _pool.finished.notify_all();
+        }
+    }
+};
+
+#endif //SAFEARRAY_PARALLEL_H
@@ -0,0 +1,404 @@
+/*
+ * Reduce class sums, searches and scans SafeArray and SafeMatrix storage without per element bounds checks
+ *
+ * Bounds are checked once per call, the loops then run over the contiguous row storage.
+ * Every result is reproducible: it depends on the data only, never on the number of threads.
+ *
+ * Details:
+ *
+ * 1.   Arrays are cut into BLOCK element blocks, the unit of work of a thread and of the summation order
+ * 2.   A block is summed in LANES independent accumulators so the loop vectorizes, the lanes are then added
+ *      pairwise in a fixed order
+ * 3.   Block results are added as a pairwise tree, so the rounding error grows with log(n) and not with n
+ * 4.   Matrix sums add every row that way and the row results as another pairwise tree
+ * 5.   min() and max() find the extreme value of a block in LANES candidates, then its first index,
+ *      exact whatever the order
+ * 6.   Row reductions split rows across threads, column reductions split columns and walk the rows in order
+ * 7.   Scans use the same blocks: block totals first, then every block is rescanned from its offset,
+ *      a single thread does both in one pass with the same arithmetic
+ * 8.   Blocks go to threads in groups of BLOCKGRAIN, smaller arrays never wake a Parallel worker
+ */
+
+#ifndef SAFEARRAY_REDUCE_H
+#define SAFEARRAY_REDUCE_H
+#ifndef SAFEARRAY_REDUCE_DEBUG
+#define SAFEARRAY_REDUCE_DEBUG true
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "SafeMatrix.h"
+#include "Parallel.h"
+
+template <typename T>
+class Reduce {
+private:
+    enum { BLOCK = 4096, LANES = 8, BLOCKGRAIN = 4, COLUMNGRAIN = 256 };
+
+public:
+    enum Operation { SUM, MIN, MAX };
+
+    // extreme element and its index within the bounds of the array
+    struct Extreme {
+        T value;
+        int index;
+    };
+
+    static T sum(const SafeArray<T> & l_SafeArray, int l_threads = 0) {
+        long n = size(l_SafeArray);
+        if (n <= 0) return T();
+        const T * a = l_SafeArray.constData();
+        return total(n, l_threads, [a](long i) { return a[i]; });
+    }
+
+    static T sum(const SafeMatrix<T> & l_SafeMatrix, int l_threads = 0) {
+        return total(l_SafeMatrix, l_threads, [](const T * l_row, long i) { return l_row[i]; });
+    }
+
+    // sum of a[i] * b[i], the arrays must hold the same number of elements
+    static T dot(const SafeArray<T> & l_a, const SafeArray<T> & l_b, int l_threads = 0) {
+        long n = size(l_a);
+        if (n != size(l_b)) {
+            if (SAFEARRAY_REDUCE_DEBUG) {
+                std::cout << "Arithmetic error: dot product of sizes " << n << "," << size(l_b) << std::endl;
+            }
+            exit(1);
+        }
+        if (n <= 0) return T();
+        const T * a = l_a.constData();
+        const T * b = l_b.constData();
+        return total(n, l_threads, [a, b](long i) { return a[i] * b[i]; });
+    }
+
+    static Extreme min(const SafeArray<T> & l_SafeArray, int l_threads = 0) {
+        const T * a = nonEmpty(l_SafeArray, "min");
+        Extreme _extreme = extreme<false>(size(l_SafeArray), l_threads, [a](long i) { return a[i]; });
+        _extreme.index += l_SafeArray.getLow();
+        return _extreme;
+    }
+
+    static Extreme max(const SafeArray<T> & l_SafeArray, int l_threads = 0) {
+        const T * a = nonEmpty(l_SafeArray, "max");
+        Extreme _extreme = extreme<true>(size(l_SafeArray), l_threads, [a](long i) { return a[i]; });
+        _extreme.index += l_SafeArray.getLow();
+        return _extreme;
+    }
+
+    // sum of |a[i]|
+    static T norm1(const SafeArray<T> & l_SafeArray, int l_threads = 0) {
+        long n = size(l_SafeArray);
+        if (n <= 0) return T();
+        const T * a = l_SafeArray.constData();
+        return total(n, l_threads, [a](long i) { return magnitude(a[i]); });
+    }
+
+    // square root of the sum of a[i]^2, in T
+    static T norm2(const SafeArray<T> & l_SafeArray, int l_threads = 0) {
+        return (T) std::sqrt(dot(l_SafeArray, l_SafeArray, l_threads));
+    }
+
+    // largest |a[i]|
+    static T normInf(const SafeArray<T> & l_SafeArray, int l_threads = 0) {
+        long n = size(l_SafeArray);
+        if (n <= 0) return T();
+        const T * a = l_SafeArray.constData();
+        return extreme<true>(n, l_threads, [a](long i) { return magnitude(a[i]); }).value;
+    }
+
+    // Frobenius norm, square root of the sum of every element squared
+    static T norm(const SafeMatrix<T> & l_SafeMatrix, int l_threads = 0) {
+        return (T) std::sqrt(total(l_SafeMatrix, l_threads, [](const T * l_row, long i) {
+            return l_row[i] * l_row[i];
+        }));
+    }
+
+    // "l_result"[row] = sum, min or max of the row, "l_result" holds one element per row
+    static void rows(const SafeMatrix<T> & l_SafeMatrix, SafeArray<T> & l_result, Operation l_operation = SUM,
+                     int l_threads = 0) {
+        long m = rowCount(l_SafeMatrix), n = colCount(l_SafeMatrix);
+        requireSize(l_result, m, "row");
+        if (m <= 0) return;
+        T * _result = l_result.data();
+        long _grain = std::max<long>(1, (long) BLOCK * BLOCKGRAIN / std::max<long>(1, n));
+        Parallel::forRange(0, m, l_threads, _grain, [&](long l_low, long l_high) {
+            for (long row = l_low; row < l_high; row++) {
+                const T * a = l_SafeMatrix.matrix[row]->constData();
+                if (l_operation == SUM) _result[row] = total(n, 1, [a](long i) { return a[i]; });
+                else if (l_operation == MIN) _result[row] = extreme<false>(n, 1, [a](long i) { return a[i]; }).value;
+                else _result[row] = extreme<true>(n, 1, [a](long i) { return a[i]; }).value;
+            }
+        });
+    }
+
+    // row reductions in a new array indexed like the rows of "l_SafeMatrix"
+    static SafeArray<T> rows(const SafeMatrix<T> & l_SafeMatrix, Operation l_operation = SUM, int l_threads = 0) {
+        SafeArray<T> _result(l_SafeMatrix.rowLow, l_SafeMatrix.rowHigh);
+        rows(l_SafeMatrix, _result, l_operation, l_threads);
+        return _result;
+    }
+
+    // "l_result"[col] = sum, min or max of the column, "l_result" holds one element per column
+    static void columns(const SafeMatrix<T> & l_SafeMatrix, SafeArray<T> & l_result, Operation l_operation = SUM,
+                        int l_threads = 0) {
+        long m = rowCount(l_SafeMatrix), n = colCount(l_SafeMatrix);
+        requireSize(l_result, n, "column");
+        if (n <= 0) return;
+        T * _result = l_result.data();
+        if (m <= 0) {
+            std::fill(_result, _result + n, T());
+            return;
+        }
+        long _grain = std::max<long>(COLUMNGRAIN, (long) BLOCK * BLOCKGRAIN / m);
+        Parallel::forRange(0, n, l_threads, _grain, [&](long l_low, long l_high) {
+            T * _out = _result + l_low;
+            long _width = l_high - l_low;
+            const T * _first = l_SafeMatrix.matrix[0]->constData() + l_low;
+            std::copy(_first, _first + _width, _out);
+            // row by row so both the rows and the results stream and the inner loop vectorizes
+            for (long row = 1; row < m; row++) {
+                const T * a = l_SafeMatrix.matrix[row]->constData() + l_low;
+                if (l_operation == SUM) {
+                    for (long col = 0; col < _width; col++) _out[col] += a[col];
+                } else if (l_operation == MIN) {
+                    for (long col = 0; col < _width; col++) _out[col] = a[col] < _out[col] ? a[col] : _out[col];
+                } else {
+                    for (long col = 0; col < _width; col++) _out[col] = _out[col] < a[col] ? a[col] : _out[col];
+                }
+            }
+        });
+    }
+
+    // column reductions in a new array indexed like the columns of "l_SafeMatrix"
+    static SafeArray<T> columns(const SafeMatrix<T> & l_SafeMatrix, Operation l_operation = SUM, int l_threads = 0) {
+        SafeArray<T> _result(l_SafeMatrix.colLow, l_SafeMatrix.colHigh);
+        columns(l_SafeMatrix, _result, l_operation, l_threads);
+        return _result;
+    }
+
+    // "l_out"[i] = in[low] + ... + in[i], "l_out" may be "l_in"
+    static void inclusiveScan(const SafeArray<T> & l_in, SafeArray<T> & l_out, int l_threads = 0) {
+        scan(l_in, l_out, T(), true, l_threads);
+    }
+
+    // "l_out"[i] = l_init + in[low] + ... + in[i - 1], "l_out" may be "l_in"
+    static void exclusiveScan(const SafeArray<T> & l_in, SafeArray<T> & l_out, T l_init = T(), int l_threads = 0) {
+        scan(l_in, l_out, l_init, false, l_threads);
+    }
+
+private:
+    static long size(const SafeArray<T> & l_SafeArray) {
+        return (long) l_SafeArray.getHigh() - l_SafeArray.getLow() + 1;
+    }
+
+    static long rowCount(const SafeMatrix<T> & l_SafeMatrix) {
+        return (long) l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1;
+    }
+
+    static long colCount(const SafeMatrix<T> & l_SafeMatrix) {
+        return (long) l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1;
+    }
+
+    static T magnitude(const T & l_value) {
+        return l_value < T() ? -l_value : l_value;
+    }
+
+    static const T * nonEmpty(const SafeArray<T> & l_SafeArray, const char * l_name) {
+        if (size(l_SafeArray) <= 0) {
+            if (SAFEARRAY_REDUCE_DEBUG) {
+                std::cout << "Arithmetic error: " << l_name << " of an empty array" << std::endl;
+            }
+            exit(1);
+        }
+        return l_SafeArray.constData();
+    }
+
+    static void requireSize(const SafeArray<T> & l_result, long l_size, const char * l_name) {
+        if (size(l_result) != l_size) {
+            if (SAFEARRAY_REDUCE_DEBUG) {
+                std::cout << "Arithmetic error: " << l_name << " reduction into size " << size(l_result)
+                          << ", expected " << l_size << std::endl;
+            }
+            exit(1);
+        }
+    }
+
+    // sum of l_term(i) for "l_begin" <= i < "l_end" in LANES accumulators
+    template <typename Term>
+    static T block(long l_begin, long l_end, const Term & l_term) {
+        T _lanes[LANES] = {};
+        long i = l_begin;
+        for (; i + LANES <= l_end; i += LANES) {
+            for (int lane = 0; lane < LANES; lane++) {
+                _lanes[lane] += l_term(i + lane);
+            }
+        }
+        for (int lane = 0; i < l_end; i++, lane++) {
+            _lanes[lane] += l_term(i);
+        }
+        for (int width = LANES / 2; width > 0; width /= 2) {
+            for (int lane = 0; lane < width; lane++) {
+                _lanes[lane] += _lanes[lane + width];
+            }
+        }
+        return _lanes[0];
+    }
+
+    // adds "l_count" values as a pairwise tree, overwriting them
+    static T pairwise(T * l_values, long l_count) {
+        while (l_count > 1) {
+            for (long i = 0; i < l_count / 2; i++) {
+                l_values[i] = l_values[2 * i] + l_values[2 * i + 1];
+            }
+            if (l_count % 2) l_values[l_count / 2] = l_values[l_count - 1];
+            l_count = (l_count + 1) / 2;
+        }
+        return l_values[0];
+    }
+
+    // sum of l_term(i) for 0 <= i < "l_count", block by block
+    template <typename Term>
+    static T total(long l_count, int l_threads, const Term & l_term) {
+        long _blocks = (l_count + BLOCK - 1) / BLOCK;
+        if (_blocks == 1) return block(0, l_count, l_term);
+        std::vector<T> _partial(_blocks);
+        Parallel::forRange(0, _blocks, l_threads, BLOCKGRAIN, [&](long l_low, long l_high) {
+            for (long index = l_low; index < l_high; index++) {
+                _partial[index] = block(index * BLOCK, std::min(l_count, (index + 1) * BLOCK), l_term);
+            }
+        });
+        return pairwise(_partial.data(), _blocks);
+    }
+
+    // sum of l_term(row, i) over every element, a pairwise tree of the row sums
+    template <typename Term>
+    static T total(const SafeMatrix<T> & l_SafeMatrix, int l_threads, const Term & l_term) {
+        long m = rowCount(l_SafeMatrix), n = colCount(l_SafeMatrix);
+        if (m <= 0 || n <= 0) return T();
+        std::vector<T> _rows(m);
+        long _grain = std::max<long>(1, (long) BLOCK * BLOCKGRAIN / n);
+        Parallel::forRange(0, m, l_threads, _grain, [&](long l_low, long l_high) {
+            for (long row = l_low; row < l_high; row++) {
+                const T * a = l_SafeMatrix.matrix[row]->constData();
+                _rows[row] = total(n, 1, [a, & l_term](long i) { return l_term(a, i); });
+            }
+        });
+        return pairwise(_rows.data(), m);
+    }
+
+    // true when "l_candidate" at "l_index" replaces "l_best" at "l_bestIndex", ties keep the first index
+    template <bool MAXIMUM>
+    static bool better(const T & l_candidate, long l_index, const T & l_best, long l_bestIndex) {
+        if (MAXIMUM ? l_best < l_candidate : l_candidate < l_best) return true;
+        return !(l_candidate < l_best) && !(l_best < l_candidate) && l_index < l_bestIndex;
+    }
+
+    // extreme of l_term(i) for "l_begin" <= i < "l_end": the value in LANES candidates, then its first index
+    template <bool MAXIMUM, typename Term>
+    static Extreme blockExtreme(long l_begin, long l_end, const Term & l_term) {
+        T _lanes[LANES];
+        std::fill(_lanes, _lanes + LANES, l_term(l_begin));
+        long i = l_begin;
+        for (; i + LANES <= l_end; i += LANES) {
+            for (int lane = 0; lane < LANES; lane++) {
+                T _candidate = l_term(i + lane);
+                _lanes[lane] = (MAXIMUM ? _lanes[lane] < _candidate : _candidate < _lanes[lane]) ? _candidate
+                                                                                                   : _lanes[lane];
+            }
+        }
+        for (int lane = 0; i < l_end; i++, lane++) {
+            T _candidate = l_term(i);
+            if (MAXIMUM ? _lanes[lane] < _candidate : _candidate < _lanes[lane]) _lanes[lane] = _candidate;
+        }
+        Extreme _best = { _lanes[0], 0 };
+        for (int lane = 1; lane < LANES; lane++) {
+            if (MAXIMUM ? _best.value < _lanes[lane] : _lanes[lane] < _best.value) _best.value = _lanes[lane];
+        }
+        // the block is still in cache for the second pass
+        for (i = l_begin; i < l_end; i++) {
+            T _candidate = l_term(i);
+            if (!(_candidate < _best.value) && !(_best.value < _candidate)) break;
+        }
+        _best.index = (int) i;
+        return _best;
+    }
+
+    // extreme of l_term(i) for 0 <= i < "l_count", "l_count" > 0, index from 0
+    template <bool MAXIMUM, typename Term>
+    static Extreme extreme(long l_count, int l_threads, const Term & l_term) {
+        long _blocks = (l_count + BLOCK - 1) / BLOCK;
+        if (_blocks == 1) return blockExtreme<MAXIMUM>(0, l_count, l_term);
+        std::vector<Extreme> _partial(_blocks);
+        Parallel::forRange(0, _blocks, l_threads, BLOCKGRAIN, [&](long l_low, long l_high) {
+            for (long index = l_low; index < l_high; index++) {
+                _partial[index] = blockExtreme<MAXIMUM>(index * BLOCK, std::min(l_count, (index + 1) * BLOCK), l_term);
+            }
+        });
+        Extreme _best = _partial[0];
+        for (long index = 1; index < _blocks; index++) {
+            if (better<MAXIMUM>(_partial[index].value, _partial[index].index, _best.value, _best.index))
+                _best = _partial[index];
+        }
+        return _best;
+    }
+
+    // prefix sums of "l_in" into "l_out" starting from "l_init", "l_inclusive" counts in[i] into out[i]
+    static void scan(const SafeArray<T> & l_in, SafeArray<T> & l_out, T l_init, bool l_inclusive, int l_threads) {
+        long n = size(l_in);
+        if (n != size(l_out)) {
+            if (SAFEARRAY_REDUCE_DEBUG) {
+                std::cout << "Arithmetic error: scan of size " << n << " into size " << size(l_out) << std::endl;
+            }
+            exit(1);
+        }
+        if (n <= 0) return;
+        // a write to shared storage gives "l_out" its own copy, so take it before reading "l_in"
+        T * _out = l_out.data();
+        const T * _in = l_in.constData();
+        long _blocks = (n + BLOCK - 1) / BLOCK;
+        int _threads = Parallel::threads(l_threads);
+        if (_threads == 1 || _blocks < 2 * BLOCKGRAIN) {
+            T _offset = l_init;
+            for (long index = 0; index < _blocks; index++) {
+                _offset = _offset + scanBlock(_in, _out, index * BLOCK, std::min(n, (index + 1) * BLOCK), _offset,
+                                              l_inclusive);
+            }
+            return;
+        }
+        std::vector<T> _offsets(_blocks);
+        Parallel::forRange(0, _blocks, _threads, BLOCKGRAIN, [&](long l_low, long l_high) {
+            for (long index = l_low; index < l_high; index++) {
+                T _local = T();
+                for (long i = index * BLOCK; i < std::min(n, (index + 1) * BLOCK); i++) {
+                    _local = _local + _in[i];
+                }
+                _offsets[index] = _local;
+            }
+        });
+        T _offset = l_init;
+        for (long index = 0; index < _blocks; index++) {
+            T _total = _offsets[index];
+            _offsets[index] = _offset;
+            _offset = _offset + _total;
+        }
+        Parallel::forRange(0, _blocks, _threads, BLOCKGRAIN, [&](long l_low, long l_high) {
+            for (long index = l_low; index < l_high; index++) {
+                scanBlock(_in, _out, index * BLOCK, std::min(n, (index + 1) * BLOCK), _offsets[index], l_inclusive);
+            }
+        });
+    }
+
+    // out[i] = "l_offset" + the sum of the block up to i, returns the block total
+    static T scanBlock(const T * l_in, T * l_out, long l_begin, long l_end, T l_offset, bool l_inclusive) {
+        T _local = T();
+        for (long i = l_begin; i < l_end; i++) {
+            T _value = l_in[i];
+            if (!l_inclusive) l_out[i] = l_offset + _local;
+            _local = _local + _value;
+            if (l_inclusive) l_out[i] = l_offset + _local;
+        }
+        return _local;
+    }
+};
+
+#endif //SAFEARRAY_REDUCE_H
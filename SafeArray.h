@@ -1,18 +1,39 @@
 /*
  * SafeArray class uses Block class to deal with memory management
+ *
+ * Copies share their Block and count references to it, the first write through operator[], data() or fillArray()
+ * gives a shared array its own copy (copy-on-write). Copying and reading a shared array is safe across threads,
+ * the copy made by a write allocates from the Block pool, which is not synchronized.
+ * Views never share, copying a view copies its elements.
+ * A T & from non const operator[] or a T * from data() points into the storage of the moment, copying the array
+ * invalidates it: take it again after the copy, or a later write through it reaches the copy too.
+ * A SafeArray made with new lives in a Slab, only its elements come from the Block pool.
+ * Elements come from a std::pmr::memory_resource instead when one is given, e.g. a BlockResource,
+ * copies share or allocate from the resource of the array they copy.
  */
 
 #ifndef SAFEARRAY_SAFEARRAY_H
 #define SAFEARRAY_SAFEARRAY_H
+#ifndef SAFEARRAY_SAFEARRAY_DEBUG
 #define SAFEARRAY_SAFEARRAY_DEBUG true
+#endif
 
+#include <atomic>
+#include <memory_resource>
 #include "Block.h"
+#include "Slab.h"
 
 template <typename T>
 class SafeArray {
 private:
     int low, high;
     Block<T> * array = nullptr;
+    // false when array is a view over memory owned elsewhere
+    bool owner = true;
+    // number of arrays sharing "array", nullptr until the storage is first shared
+    mutable std::atomic<std::atomic<int> *> refs{nullptr};
+    // source of the elements, nullptr for the Block<T> pool
+    std::pmr::memory_resource * resource = nullptr;
 
 public:
     // default constructor to allow creation on stack "SafeArray<T> a;"
@@ -28,29 +49,27 @@ public:
             }
             exit(1);
         }
-        array = new ((high + 1) * sizeof(T)) Block<T>;
-        if (array)
-            fillArray(T());
+        array = allocateStorage(high + 1);
+        fillArray(T());
     }
 
-    // construct array with explicit lower and upper bounds
-    explicit SafeArray(int l_low, int l_high)
-            : low(l_low), high(l_high) {
+    // construct array with explicit lower and upper bounds, elements from "l_resource" if given
+    explicit SafeArray(int l_low, int l_high, std::pmr::memory_resource * l_resource = nullptr)
+            : low(l_low), high(l_high), resource(l_resource) {
         if (high - low < 0) {
             if (SAFEARRAY_SAFEARRAY_DEBUG) {
                 std::cout << "Constructor error: bounds definition" << std::endl;
             }
             exit(1);
         }
-        array = new ((high - low + 1) * sizeof(T)) Block<T>;
-        if (array)
-            fillArray(T());
+        array = allocateStorage(high - low + 1);
+        fillArray(T());
     }
 
     // initializer_list constructor to allow "SafeArray<T> a{ t0, t1 }"
     explicit SafeArray(const std::initializer_list<T> & init_list)
             : low(0), high(init_list.size() - 1) {
-        array = new ((high - low + 1) * sizeof(T)) Block<T>;
+        array = allocateStorage(high - low + 1);
         auto it = begin(init_list);
         for (int col = 0; col <= high; col++) {
             (* array)[col] = (* it);
@@ -58,22 +77,74 @@ public:
         }
     }
 
-    // copy constructor
+    // construct array as a view over "l_data" without copying, the memory is not released by the array
+    explicit SafeArray(T * l_data, int l_low, int l_high)
+            : low(l_low), high(l_high), array(reinterpret_cast<Block<T> *>(l_data)), owner(false) {
+        if (high - low < 0) {
+            if (SAFEARRAY_SAFEARRAY_DEBUG) {
+                std::cout << "Constructor error: bounds definition" << std::endl;
+            }
+            exit(1);
+        }
+    }
+
+    // copy constructor, shares the storage of "l_SafeArray" until either array is written
     SafeArray(const SafeArray & l_SafeArray)
             : low(l_SafeArray.low), high(l_SafeArray.high) {
-        int cols = high - low + 1;
-        array = new (cols * sizeof(T)) Block<T>;
-        for (int col = 0; col < cols; col++) {
-            (* array)[col] = (* l_SafeArray.array)[col];
-        }
+        share(l_SafeArray);
     }
 
     ~ SafeArray() {
-        if (array)
-            delete array;
+        release();
+    }
+
+    // "new SafeArray<T>(...)" takes the object from a Slab instead of the global heap
+    static void * operator new(std::size_t l_size) {
+        if (l_size != sizeof(SafeArray)) return ::operator new(l_size);
+        return Slab<sizeof(SafeArray), alignof(SafeArray)>::allocate();
+    }
+
+    static void operator delete(void * l_object, std::size_t l_size) {
+        if (l_size != sizeof(SafeArray)) ::operator delete(l_object);
+        else Slab<sizeof(SafeArray), alignof(SafeArray)>::deallocate(l_object);
+    }
+
+    int getLow() const {
+        return low;
+    }
+
+    int getHigh() const {
+        return high;
+    }
+
+    std::pmr::memory_resource * getResource() const {
+        return resource;
+    }
+
+    // contiguous storage of the elements from low to high, writable so shared storage is copied first
+    T * data() {
+        detach();
+        return array->data;
+    }
+
+    const T * data() const {
+        return array->data;
+    }
+
+    // read only storage of a non const array without copying shared storage
+    const T * constData() const {
+        return array->data;
+    }
+
+    // true while the storage is shared with a copy
+    bool isShared() const {
+        std::atomic<int> * _refs = refs.load(std::memory_order_acquire);
+        return _refs && _refs->load(std::memory_order_acquire) > 1;
     }
 
     void fillArray(T element) {
+        // every element is overwritten, shared elements need not be copied
+        detach(false);
         int cols = high - low + 1;
         for (int col = 0; col < cols; col++) {
             (* array)[col] = element;
@@ -82,6 +153,18 @@ public:
 
     // overload the [] operator to allow "a[index] = T();"
     T & operator[](const int & index) {
+        if (index < low || index > high) {
+            if (SAFEARRAY_SAFEARRAY_DEBUG) {
+                std::cout << "Index selector error: bounds selection " << index << " " << low << "-" << high
+                          << std::endl;
+            }
+            exit(1);
+        }
+        detach();
+        return (* array)[index - low];
+    }
+
+    const T & operator[](const int & index) const {
         if (index < low || index > high) {
             if (SAFEARRAY_SAFEARRAY_DEBUG) {
                 std::cout << "Index selector error: bounds selection " << index << " " << low << "-" << high
@@ -95,18 +178,14 @@ public:
     // overload the = operator to allow "SafeArray<T> sa1 = sa2;"
     SafeArray<T> & operator=(const SafeArray & l_SafeArray) {
         if (this == & l_SafeArray) return * this;
+        release();
         low = l_SafeArray.low;
         high = l_SafeArray.high;
-        int cols = high - low + 1;
-        delete array;
-        array = new (cols * sizeof(T)) Block<T>;
-        for (int col = 0; col < cols; col++) {
-            (* array)[col] = (* l_SafeArray.array)[col];
-        }
+        share(l_SafeArray);
         return * this;
     }
 
-    SafeArray<T> & operator+(SafeArray l_SafeArray) {
+    SafeArray<T> & operator+(const SafeArray & l_SafeArray) {
         // SafeArray a(x) = b(x) + c(y) if and only if x = y
         if (high - low != l_SafeArray.high - l_SafeArray.low) {
             if (SAFEARRAY_SAFEARRAY_DEBUG) {
@@ -118,13 +197,13 @@ public:
         SafeArray<T> * result = new SafeArray<T>(* this);
         int y = l_SafeArray.low;
         for (int x = this->low; x <= this->high; x++) {
-            (* result)[x] = (* array)[x] + l_SafeArray[y];
+            (* result)[x] = (* array)[x - low] + l_SafeArray[y];
             y++;
         }
         return * result;
     }
 
-    SafeArray<T> & operator-(SafeArray l_SafeArray) {
+    SafeArray<T> & operator-(const SafeArray & l_SafeArray) {
         // SafeArray a(x) = b(x) - c(y) if and only if x = y
         if (high - low != l_SafeArray.high - l_SafeArray.low) {
             if (SAFEARRAY_SAFEARRAY_DEBUG) {
@@ -136,13 +215,13 @@ public:
         SafeArray<T> * result = new SafeArray<T>(* this);
         int y = l_SafeArray.low;
         for (int x = this->low; x <= this->high; x++) {
-            (* result)[x] = (* array)[x] - l_SafeArray[y];
+            (* result)[x] = (* array)[x - low] - l_SafeArray[y];
             y++;
         }
         return * result;
     }
 
-    SafeArray<T> & operator*(SafeArray l_SafeArray) {
+    SafeArray<T> & operator*(const SafeArray & l_SafeArray) {
         // SafeArray a(x) = b(x) * c(y) if and only if x = y
         if (high - low != l_SafeArray.high - l_SafeArray.low) {
             if (SAFEARRAY_SAFEARRAY_DEBUG) {
@@ -154,7 +233,7 @@ public:
         SafeArray<T> * result = new SafeArray<T>(* this);
         int y = l_SafeArray.low;
         for (int x = this->low; x <= this->high; x++) {
-            (* result)[x] = (* array)[x] * l_SafeArray[y];
+            (* result)[x] = (* array)[x - low] * l_SafeArray[y];
             y++;
         }
         return * result;
@@ -167,6 +246,84 @@ public:
         }
         return l_ostream;
     }
+
+private:
+    // take the storage of "l_SafeArray" as a shared reference, views and empty arrays are copied instead
+    void share(const SafeArray & l_SafeArray) {
+        owner = true;
+        resource = l_SafeArray.resource;
+        if (!l_SafeArray.array) {
+            array = nullptr;
+        } else if (!l_SafeArray.owner) {
+            int cols = high - low + 1;
+            array = allocateStorage(cols);
+            for (int col = 0; col < cols; col++) {
+                (* array)[col] = (* l_SafeArray.array)[col];
+            }
+        } else {
+            std::atomic<int> * _refs = l_SafeArray.refs.load(std::memory_order_acquire);
+            if (!_refs) {
+                // first copy, the source becomes the first of two owners
+                std::atomic<int> * _created = new std::atomic<int>(1);
+                if (l_SafeArray.refs.compare_exchange_strong(_refs, _created, std::memory_order_acq_rel))
+                    _refs = _created;
+                else
+                    delete _created;
+            }
+            _refs->fetch_add(1, std::memory_order_relaxed);
+            array = l_SafeArray.array;
+            refs.store(_refs, std::memory_order_relaxed);
+        }
+    }
+
+    // drop this array's reference, the last owner frees the storage
+    void release() {
+        std::atomic<int> * _refs = refs.load(std::memory_order_relaxed);
+        if (_refs) {
+            if (_refs->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete _refs;
+                freeStorage(array);
+            }
+        } else if (array && owner) {
+            freeStorage(array);
+        }
+        refs.store(nullptr, std::memory_order_relaxed);
+        array = nullptr;
+    }
+
+    // storage for "l_cols" elements from the resource or the Block pool, an exhausted pool ends the program
+    Block<T> * allocateStorage(int l_cols) {
+        if (resource) return reinterpret_cast<Block<T> *>(resource->allocate(l_cols * sizeof(T), alignof(T)));
+        Block<T> * _array = new (l_cols * sizeof(T)) Block<T>;
+        if (!_array) {
+            if (SAFEARRAY_SAFEARRAY_DEBUG) {
+                std::cout << "Constructor error: block allocation " << l_cols * sizeof(T) << std::endl;
+            }
+            exit(1);
+        }
+        return _array;
+    }
+
+    // "l_array" holds high - low + 1 elements
+    void freeStorage(Block<T> * l_array) {
+        if (!resource) delete l_array;
+        else resource->deallocate(l_array, (high - low + 1) * sizeof(T), alignof(T));
+    }
+
+    // give this array storage of its own before a write, copying the elements when "l_copy"
+    inline void detach(bool l_copy = true) {
+        std::atomic<int> * _refs = refs.load(std::memory_order_relaxed);
+        if (!_refs || _refs->load(std::memory_order_acquire) == 1) return;
+        int cols = high - low + 1;
+        Block<T> * _array = allocateStorage(cols);
+        if (l_copy) {
+            for (int col = 0; col < cols; col++) {
+                (* _array)[col] = (* array)[col];
+            }
+        }
+        release();
+        array = _array;
+    }
 };
 
 #endif //SAFEARRAY_SAFEARRAY_H
\ No newline at end of file
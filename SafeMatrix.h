@@ -1,10 +1,24 @@
 /*
  * SafeMatrix class uses SafeArray class to create a 2D matrix
+ *
+ * Copies share the table of rows behind one reference count, so a copy costs O(1) whatever the size.
+ * The first write through operator[], rows() or fillMatrix() gives the matrix a table of its own whose rows
+ * still share their elements, and each row is copied only when it is first written (copy-on-write).
+ * "matrix" is the row table for reading, code writing rows goes through rows() or operator[].
+ * A row or element reference, or a pointer from data(), is invalidated by copying the matrix: take it again
+ * after the copy, or a later write through it reaches the copy too.
+ * Copying a view, e.g. a mapped MatrixFile, copies its elements so the copy outlives the mapping.
+ *
+ * The row table, the row objects and a SafeMatrix made with new come from Slab, rows are created in order
+ * and released in reverse, so the row objects of a matrix stay next to each other across reuse.
+ * Row elements come from a std::pmr::memory_resource when one is given, copies and products keep using it.
  */
 
 #ifndef SAFEARRAY_SAFEMATRIX_H
 #define SAFEARRAY_SAFEMATRIX_H
+#ifndef SAFEARRAY_SAFEMATRIX_DEBUG
 #define SAFEARRAY_SAFEMATRIX_DEBUG true
+#endif
 
 #include "SafeArray.h"
 
@@ -12,12 +26,21 @@ template <typename T>
 class SafeMatrix {
 public:
     int rowLow, rowHigh, colLow, colHigh;
+    // row table, shared with copies until one of them is written
     SafeArray<T> ** matrix;
 
+private:
+    // number of matrices sharing "matrix", nullptr until the table is first shared
+    mutable std::atomic<std::atomic<int> *> refs{nullptr};
+    // false when the rows are views over memory owned elsewhere
+    bool owner = true;
+    // source of the row elements, nullptr for the Block<T> pool
+    std::pmr::memory_resource * resource = nullptr;
+
 public:
     // default constructor to allow "SafeMatrix<T> a;"
     SafeMatrix()
-            : rowLow(0), rowHigh(-1), colLow(0), colHigh(-1) {};
+            : rowLow(0), rowHigh(-1), colLow(0), colHigh(-1), matrix(nullptr) {};
 
     // construct matrix with upper bound
     explicit SafeMatrix(int l_High)
@@ -29,7 +52,7 @@ public:
             exit(1);
         }
         // create array of SafeArray
-        this->matrix = new SafeArray<T> * [l_High + 1];
+        this->matrix = newTable(l_High + 1);
         for (int row = 0; row <= l_High; row++) {
             this->matrix[row] = new SafeArray<T>(l_High);
         }
@@ -45,15 +68,16 @@ public:
             exit(1);
         }
         // create array of SafeArray
-        matrix = new SafeArray<T> * [rowHigh + 1];
+        matrix = newTable(rowHigh + 1);
         for (int row = 0; row <= rowHigh; row++) {
             matrix[row] = new SafeArray<T>(colHigh);
         }
     }
 
-    // construct matrix with lower and upper bounds for row and column
-    explicit SafeMatrix(int l_rowLow, int l_rowHigh, int l_colLow, int l_colHigh)
-            : rowLow(l_rowLow), rowHigh(l_rowHigh), colLow(l_colLow), colHigh(l_colHigh) {
+    // construct matrix with lower and upper bounds for row and column, row elements from "l_resource" if given
+    explicit SafeMatrix(int l_rowLow, int l_rowHigh, int l_colLow, int l_colHigh,
+                        std::pmr::memory_resource * l_resource = nullptr)
+            : rowLow(l_rowLow), rowHigh(l_rowHigh), colLow(l_colLow), colHigh(l_colHigh), resource(l_resource) {
         if ((rowHigh - rowLow) < 0 || (colHigh - colLow) < 0) {
             if (SAFEARRAY_SAFEMATRIX_DEBUG) {
                 std::cout << "Constructor error: bounds definition" << std::endl;
@@ -61,9 +85,9 @@ public:
             exit(1);
         }
         // create array of SafeArray
-        matrix = new SafeArray<T> * [rowHigh - rowLow + 1];
+        matrix = newTable(rowHigh - rowLow + 1);
         for (int row = 0; row <= (rowHigh - rowLow); row++) {
-            matrix[row] = new SafeArray<T>(colLow, colHigh);
+            matrix[row] = new SafeArray<T>(colLow, colHigh, resource);
         }
     }
 
@@ -71,7 +95,7 @@ public:
     explicit SafeMatrix(const std::initializer_list<std::initializer_list<T>> & int_list)
             : rowLow(0), rowHigh(int_list.size() - 1), colLow(0), colHigh((* begin(int_list)).size() - 1) {
         int rows = rowHigh - rowLow + 1;
-        matrix = new SafeArray<T> * [rows];
+        matrix = newTable(rows);
         auto it = begin(int_list);
         for (int row = 0; row < rows; row++) {
             if ((* it).size() - 1 != colHigh) {
@@ -85,21 +109,62 @@ public:
         }
     };
 
-    // copy constructor
-    SafeMatrix(const SafeMatrix<T> & l_SafeMatrix)
-            : rowLow(l_SafeMatrix.rowLow), rowHigh(l_SafeMatrix.rowHigh), colLow(l_SafeMatrix.colLow), colHigh(l_SafeMatrix.colHigh) {
+    // construct matrix as a view over row major "l_data" without copying, e.g. a mapped MatrixFile
+    explicit SafeMatrix(T * l_data, int l_rowLow, int l_rowHigh, int l_colLow, int l_colHigh)
+            : rowLow(l_rowLow), rowHigh(l_rowHigh), colLow(l_colLow), colHigh(l_colHigh), owner(false) {
+        if ((rowHigh - rowLow) < 0 || (colHigh - colLow) < 0) {
+            if (SAFEARRAY_SAFEMATRIX_DEBUG) {
+                std::cout << "Constructor error: bounds definition" << std::endl;
+            }
+            exit(1);
+        }
         int rows = rowHigh - rowLow + 1;
-        matrix = new SafeArray<T> * [rows];
+        int cols = colHigh - colLow + 1;
+        matrix = newTable(rows);
         for (int row = 0; row < rows; row++) {
-            matrix[row] = new SafeArray<T>(* l_SafeMatrix.matrix[row]);
+            matrix[row] = new SafeArray<T>(l_data + (std::size_t) row * cols, colLow, colHigh);
         }
     }
 
+    // copy constructor, shares the row table of "l_SafeMatrix" until either matrix is written
+    SafeMatrix(const SafeMatrix<T> & l_SafeMatrix)
+            : rowLow(l_SafeMatrix.rowLow), rowHigh(l_SafeMatrix.rowHigh), colLow(l_SafeMatrix.colLow), colHigh(l_SafeMatrix.colHigh) {
+        share(l_SafeMatrix);
+    }
+
     ~ SafeMatrix() {
-        delete[] matrix;
+        release();
+    }
+
+    // "new SafeMatrix<T>(...)" takes the object from a Slab instead of the global heap
+    static void * operator new(std::size_t l_size) {
+        if (l_size != sizeof(SafeMatrix)) return ::operator new(l_size);
+        return Slab<sizeof(SafeMatrix), alignof(SafeMatrix)>::allocate();
+    }
+
+    static void operator delete(void * l_object, std::size_t l_size) {
+        if (l_size != sizeof(SafeMatrix)) ::operator delete(l_object);
+        else Slab<sizeof(SafeMatrix), alignof(SafeMatrix)>::deallocate(l_object);
+    }
+
+    std::pmr::memory_resource * getResource() const {
+        return resource;
+    }
+
+    // row table for writing, a shared table is copied first
+    SafeArray<T> ** rows() {
+        detach();
+        return matrix;
+    }
+
+    // true while the row table is shared with a copy
+    bool isShared() const {
+        std::atomic<int> * _refs = refs.load(std::memory_order_acquire);
+        return _refs && _refs->load(std::memory_order_acquire) > 1;
     }
 
     void fillMatrix(T element) {
+        detach();
         int rows = rowHigh - rowLow + 1;
         for (int row = 0; row < rows; row++) {
             matrix[row]->fillArray(element);
@@ -115,26 +180,35 @@ public:
             }
             exit(1);
         }
-        return * matrix[index - colLow];
+        detach();
+        return * matrix[index - rowLow];
+    }
+
+    // read only row, "a[row][column]" on a const matrix does not copy shared rows
+    const SafeArray<T> & operator[](int index) const {
+        if (index < rowLow || index > rowHigh) {
+            if (SAFEARRAY_SAFEMATRIX_DEBUG) {
+                std::cout << "Index selector error: bounds selection " << index << " in " << rowLow << "-" << rowHigh
+                          << std::endl;
+            }
+            exit(1);
+        }
+        return * matrix[index - rowLow];
     }
 
     // overload the = operator to allow "SafeMatrix<T> a = b;"
     SafeMatrix<T> & operator=(const SafeMatrix<T> & l_SafeMatrix) {
         if (this == & l_SafeMatrix) return * this;
+        release();
         rowLow = l_SafeMatrix.rowLow;
         rowHigh = l_SafeMatrix.rowHigh;
         colLow = l_SafeMatrix.colLow;
         colHigh = l_SafeMatrix.colHigh;
-        int rows = rowHigh - rowLow + 1;
-        delete[] matrix;
-        matrix = new SafeArray<T> * [rows];
-        for (int row = 0; row < rows; row++) {
-            matrix[row] = l_SafeMatrix.matrix[row];
-        }
+        share(l_SafeMatrix);
         return * this;
     }
 
-    SafeMatrix<T> & operator+(SafeMatrix<T> l_SafeMatrix) {
+    SafeMatrix<T> & operator+(const SafeMatrix<T> & l_SafeMatrix) {
         // SafeMatrix a(x,y) = b(x,y) + c(m,n) if and only if x = m and y = n
         if ( rowHigh - rowLow != l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow
             || colHigh - colLow != l_SafeMatrix.colHigh - l_SafeMatrix.colLow) {
@@ -147,16 +221,17 @@ public:
             }
             exit(1);
         }
+        Trace::Scope _trace(Trace::MATRIX_ADD, rowHigh - rowLow + 1, colHigh - colLow + 1);
         // create resulting matrix a(x,y)
         SafeMatrix * result = new SafeMatrix(* this);
         int m = l_SafeMatrix.rowLow;
         for (int x = this->rowLow; x <= this->rowHigh; x++){
-            (* result)[x] = (* matrix[x]) + l_SafeMatrix[m];
+            (* result)[x] = (* matrix[x - rowLow]) + l_SafeMatrix[m++];
         }
         return * result;
     }
 
-    SafeMatrix<T> & operator-(SafeMatrix<T> l_SafeMatrix) {
+    SafeMatrix<T> & operator-(const SafeMatrix<T> & l_SafeMatrix) {
         // SafeMatrix a(x,y) = b(x,y) - c(m,n) if and only if x = m and y = n
         if ( rowHigh - rowLow != l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow
              || colHigh - colLow != l_SafeMatrix.colHigh - l_SafeMatrix.colLow) {
@@ -169,16 +244,17 @@ public:
             }
             exit(1);
         }
+        Trace::Scope _trace(Trace::MATRIX_SUBTRACT, rowHigh - rowLow + 1, colHigh - colLow + 1);
         // create resulting matrix a(x,y)
         SafeMatrix * result = new SafeMatrix(* this);
         int m = l_SafeMatrix.rowLow;
         for (int x = this->rowLow; x <= this->rowHigh; x++){
-            (* result)[x] = (* matrix[x]) - l_SafeMatrix[m];
+            (* result)[x] = (* matrix[x - rowLow]) - l_SafeMatrix[m++];
         }
         return * result;
     }
 
-    SafeMatrix<T> & operator*(SafeMatrix<T> l_SafeMatrix) {
+    SafeMatrix<T> & operator*(const SafeMatrix<T> & l_SafeMatrix) {
         // SafeMatrix a(x,m) = b(x,y) * c(m,n) if and only if y = m
         if (colHigh - colLow != l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow) {
             if (SAFEARRAY_SAFEMATRIX_DEBUG) {
@@ -187,16 +263,19 @@ public:
             }
             exit(1);
         }
+        Trace::Scope _trace(Trace::MATRIX_MULTIPLY, rowHigh - rowLow + 1, colHigh - colLow + 1,
+                            l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1);
         // create resulting matrix a(x,m)
-        SafeMatrix * result = new SafeMatrix(rowLow, rowHigh, l_SafeMatrix.colLow, l_SafeMatrix.colHigh);
+        SafeMatrix * result = new SafeMatrix(rowLow, rowHigh, l_SafeMatrix.colLow, l_SafeMatrix.colHigh, resource);
         int commonSize = colHigh - colLow + 1;
+        const SafeMatrix<T> & self = * this;
         // visit each index in matrix a
         for(int row = rowLow; row <= rowHigh; row++) {
             for (int column = l_SafeMatrix.colLow; column <= l_SafeMatrix.colHigh; column++) {
                 T sum = T();
                 // store sum of row column products into index
                 for (int i = 0; i < commonSize; i++) {
-                    sum += (* this)[row][colLow + i] * l_SafeMatrix[l_SafeMatrix.rowLow + i][column];
+                    sum += self[row][colLow + i] * l_SafeMatrix[l_SafeMatrix.rowLow + i][column];
                 }
                 (* result)[row][column] = sum;
             }
@@ -207,11 +286,84 @@ public:
     friend std::ostream & operator<<(std::ostream & l_ostream, const SafeMatrix<T> & l_SafeMatrix) {
         int size = l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1;
         for (int row = 0; row < size; row++) {
-            l_ostream << * l_SafeMatrix.matrix[row] << std::endl;
+            l_ostream << * l_SafeMatrix.matrix[row] << '\n';
         }
         return l_ostream;
     }
 
+private:
+    // take the row table of "l_SafeMatrix" as a shared reference, a table of views is copied instead
+    void share(const SafeMatrix<T> & l_SafeMatrix) {
+        resource = l_SafeMatrix.resource;
+        owner = true;
+        if (!l_SafeMatrix.matrix) {
+            matrix = nullptr;
+        } else if (!l_SafeMatrix.owner) {
+            matrix = copyTable(l_SafeMatrix.matrix);
+        } else {
+            std::atomic<int> * _refs = l_SafeMatrix.refs.load(std::memory_order_acquire);
+            if (!_refs) {
+                // first copy, the source becomes the first of two owners
+                std::atomic<int> * _created = new std::atomic<int>(1);
+                if (l_SafeMatrix.refs.compare_exchange_strong(_refs, _created, std::memory_order_acq_rel))
+                    _refs = _created;
+                else
+                    delete _created;
+            }
+            _refs->fetch_add(1, std::memory_order_relaxed);
+            matrix = l_SafeMatrix.matrix;
+            refs.store(_refs, std::memory_order_relaxed);
+        }
+    }
+
+    // drop this matrix's reference, the last owner deletes the rows and the table
+    void release() {
+        std::atomic<int> * _refs = refs.load(std::memory_order_relaxed);
+        if (_refs) {
+            if (_refs->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete _refs;
+                deleteRows();
+            }
+        } else if (matrix) {
+            deleteRows();
+        }
+        refs.store(nullptr, std::memory_order_relaxed);
+        matrix = nullptr;
+    }
+
+    // give this matrix a row table of its own before a write, its rows keep sharing their elements
+    void detach() {
+        std::atomic<int> * _refs = refs.load(std::memory_order_relaxed);
+        if (!_refs || _refs->load(std::memory_order_acquire) == 1) return;
+        SafeArray<T> ** _table = copyTable(matrix);
+        release();
+        matrix = _table;
+    }
+
+    // new table holding a copy of every row of "l_table", rows created in order
+    SafeArray<T> ** copyTable(SafeArray<T> ** l_table) const {
+        int rows = rowHigh - rowLow + 1;
+        SafeArray<T> ** _table = newTable(rows);
+        for (int row = 0; row < rows; row++) {
+            _table[row] = new SafeArray<T>(* l_table[row]);
+        }
+        return _table;
+    }
+
+    // uninitialized row table of "l_rows" pointers
+    static SafeArray<T> ** newTable(int l_rows) {
+        return SlabArray<SafeArray<T> *>::allocate(l_rows);
+    }
+
+    // rows go back last first, so the next matrix gets its row objects in address order
+    void deleteRows() {
+        int rows = rowHigh - rowLow + 1;
+        for (int row = rows - 1; row >= 0; row--) {
+            delete matrix[row];
+        }
+        SlabArray<SafeArray<T> *>::deallocate(matrix, rows > 0 ? rows : 0);
+        matrix = nullptr;
+    }
 };
 
 #endif //SAFEARRAY_SAFEMATRIX_H
\ No newline at end of file
@@ -0,0 +1,245 @@
+/*
+ * Slab class hands out fixed-size objects for the small control structures around Block payloads
+ *
+ * SafeArray and SafeMatrix objects created with new and SafeMatrix row tables come from here instead of
+ * the global heap, so building a matrix touches the system allocator once per chunk, not once per row.
+ *
+ * Details:
+ *
+ * 1.   One pool per object size, shared by every type of that size
+ * 2.   Objects are cut in address order from chunks of SAFEARRAY_SLAB_CHUNK bytes, so the rows of a
+ *      new matrix sit next to each other
+ * 3.   Every thread allocates from its own LIFO free list and its own part of a chunk without locking,
+ *      objects move to and from the shared pool, under a spin lock, in batches
+ * 4.   Objects a thread holds when it finishes go back to the shared pool
+ * 5.   Chunks are kept for the life of the program, like Block arenas
+ * 6.   SlabArray keeps arrays such as row tables in power of two size classes, larger arrays use new[]
+ * 7.   "#define SAFEARRAY_SLAB false" sends every request to the global heap, e.g. for a memory checker
+ */
+
+#ifndef SAFEARRAY_SLAB_H
+#define SAFEARRAY_SLAB_H
+#ifndef SAFEARRAY_SLAB
+#define SAFEARRAY_SLAB true
+#endif
+#ifndef SAFEARRAY_SLAB_CHUNK
+#define SAFEARRAY_SLAB_CHUNK 16384
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <thread>
+
+template <std::size_t SIZE, std::size_t ALIGN = alignof(void *)>
+class Slab {
+private:
+    struct Node {
+        Node * next;
+    };
+
+    // object size rounded up to the alignment, large enough for a free list link
+    static constexpr std::size_t ALIGNMENT = ALIGN > alignof(Node) ? ALIGN : alignof(Node);
+    static constexpr std::size_t OBJECTSIZE = ((SIZE > sizeof(Node) ? SIZE : sizeof(Node)) + ALIGNMENT - 1)
+                                              / ALIGNMENT * ALIGNMENT;
+    // a chunk starts with the link to the previous chunk, padded to the alignment
+    static constexpr std::size_t HEADSIZE = (sizeof(Node) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    static constexpr std::size_t OBJECTS = SAFEARRAY_SLAB_CHUNK / OBJECTSIZE > 8 ? SAFEARRAY_SLAB_CHUNK / OBJECTSIZE : 8;
+    // objects moved between a thread and the shared pool at a time
+    static constexpr std::size_t BATCH = OBJECTS / 2 > 4 ? OBJECTS / 2 : 4;
+    static_assert(ALIGNMENT <= alignof(std::max_align_t), "Slab alignment beyond the global heap");
+
+    // shared by every thread, trivially destructible and constant initialized
+    struct Pool {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        Node * free = nullptr;
+        Node * chunks = nullptr;
+        std::size_t chunkCount = 0;
+    };
+
+    // owned by one thread, constant initialized so the common path needs no thread_local guard
+    struct Local {
+        Node * free;
+        Node * tail;
+        std::size_t count;
+        char * next;
+        char * end;
+    };
+
+    class Guard {
+    private:
+        std::atomic_flag & lock;
+
+    public:
+        explicit Guard(std::atomic_flag & l_lock) : lock(l_lock) {
+            while (lock.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+        ~Guard() {
+            lock.clear(std::memory_order_release);
+        }
+    };
+
+    // hands the objects of a finished thread back to the pool, created when the thread first refills
+    struct Reclaim {
+        ~Reclaim() {
+            Local & _local = local();
+            while (_local.next != _local.end) {
+                push(_local, reinterpret_cast<Node *>(_local.next));
+                _local.next += OBJECTSIZE;
+            }
+            flush(_local);
+        }
+    };
+
+    static Pool pool;
+
+public:
+    // storage for one object of SIZE bytes
+    static void * allocate() {
+        if (!SAFEARRAY_SLAB) return ::operator new(SIZE);
+        Local & _local = local();
+        if (Node * _node = _local.free) {
+            _local.free = _node->next;
+            _local.count--;
+            return _node;
+        }
+        if (_local.next == _local.end) return refill(_local);
+        void * _object = _local.next;
+        _local.next += OBJECTSIZE;
+        return _object;
+    }
+
+    static void deallocate(void * l_object) noexcept {
+        if (!l_object) return;
+        if (!SAFEARRAY_SLAB) {
+            ::operator delete(l_object);
+            return;
+        }
+        Local & _local = local();
+        if (!_local.free) reclaim();
+        push(_local, static_cast<Node *>(l_object));
+        if (_local.count > 2 * BATCH) flush(_local);
+    }
+
+    // chunks taken from the global heap
+    static std::size_t chunks() {
+        Guard _guard(pool.lock);
+        return pool.chunkCount;
+    }
+
+private:
+    static Local & local() {
+        static thread_local Local _local = { nullptr, nullptr, 0, nullptr, nullptr };
+        return _local;
+    }
+
+    // make sure this thread's objects return to the pool when it finishes
+    static void reclaim() {
+        static thread_local Reclaim _reclaim;
+        (void) & _reclaim;
+    }
+
+    static void push(Local & l_local, Node * l_node) {
+        if (!l_local.free) l_local.tail = l_node;
+        l_node->next = l_local.free;
+        l_local.free = l_node;
+        l_local.count++;
+    }
+
+    // return every free object of this thread to the pool
+    static void flush(Local & l_local) {
+        if (!l_local.free) return;
+        Guard _guard(pool.lock);
+        l_local.tail->next = pool.free;
+        pool.free = l_local.free;
+        l_local.free = l_local.tail = nullptr;
+        l_local.count = 0;
+    }
+
+    // take up to BATCH objects freed by any thread, or cut a new chunk, and return one of them
+    static void * refill(Local & l_local) {
+        reclaim();
+        {
+            Guard _guard(pool.lock);
+            Node * _first = pool.free;
+            if (_first) {
+                Node * _last = _first;
+                std::size_t _count = 1;
+                while (_count < BATCH && _last->next) {
+                    _last = _last->next;
+                    _count++;
+                }
+                pool.free = _last->next;
+                _last->next = nullptr;
+                l_local.free = _first->next;
+                l_local.tail = _first->next ? _last : nullptr;
+                l_local.count = _count - 1;
+                return _first;
+            }
+        }
+        char * _chunk = static_cast<char *>(::operator new(HEADSIZE + OBJECTS * OBJECTSIZE));
+        {
+            Guard _guard(pool.lock);
+            Node * _head = reinterpret_cast<Node *>(_chunk);
+            _head->next = pool.chunks;
+            pool.chunks = _head;
+            pool.chunkCount++;
+        }
+        l_local.next = _chunk + HEADSIZE + OBJECTSIZE;
+        l_local.end = _chunk + HEADSIZE + OBJECTS * OBJECTSIZE;
+        return _chunk + HEADSIZE;
+    }
+};
+
+template <std::size_t SIZE, std::size_t ALIGN>
+typename Slab<SIZE, ALIGN>::Pool Slab<SIZE, ALIGN>::pool;
+
+// arrays of up to 2^(CLASSES - 1) elements of a trivial type, from the Slab of their power of two size class
+template <typename Element>
+class SlabArray {
+public:
+    enum { CLASSES = 10 };
+
+    // uninitialized storage for "l_count" elements
+    static Element * allocate(std::size_t l_count) {
+        if (l_count == 0) return nullptr;
+        int _class = sizeClass(l_count);
+        if (_class >= CLASSES) return new Element[l_count];
+        return static_cast<Element *>(dispatch(_class, nullptr));
+    }
+
+    // "l_count" must be the count the array was allocated with
+    static void deallocate(Element * l_array, std::size_t l_count) noexcept {
+        if (!l_array) return;
+        int _class = sizeClass(l_count);
+        if (_class >= CLASSES) {
+            delete[] l_array;
+            return;
+        }
+        dispatch(_class, l_array);
+    }
+
+private:
+    static int sizeClass(std::size_t l_count) {
+        int _class = 0;
+        while (((std::size_t) 1 << _class) < l_count) _class++;
+        return _class;
+    }
+
+    // allocate from size class "l_class" when "l_array" is nullptr, otherwise return "l_array" to it
+    template <int CLASS = 0>
+    static void * dispatch(int l_class, Element * l_array) {
+        if constexpr (CLASS + 1 < CLASSES) {
+            if (l_class != CLASS) return dispatch<CLASS + 1>(l_class, l_array);
+        }
+        typedef Slab<sizeof(Element) << CLASS, alignof(Element)> Class;
+        if (!l_array) return Class::allocate();
+        Class::deallocate(l_array);
+        return nullptr;
+    }
+};
+
+#endif //SAFEARRAY_SLAB_H
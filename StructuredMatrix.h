@@ -0,0 +1,435 @@
+/*
+ * StructuredMatrix class stores a square symmetric, triangular or banded matrix in one packed Block
+ *
+ * Only the elements the structure allows are stored, "a[row][column]" stays bounds checked and reads an
+ * implicit zero as T(). Multiply kernels visit stored elements only.
+ *
+ * Storage, n = high - low + 1:
+ * SYMMETRIC    lower triangle row by row, n(n+1)/2 elements, a[i][j] and a[j][i] are the same element
+ * LOWER        lower triangle row by row, n(n+1)/2 elements
+ * UPPER        upper triangle row by row, n(n+1)/2 elements
+ * BANDED       "lower" diagonals below and "upper" above the main one, n(lower + upper + 1) elements,
+ *              row i keeps lower + upper + 1 slots even where the band runs off the matrix
+ *
+ * Details:
+ *
+ * 1.   Every row stores a contiguous run of columns, first(i)..last(i), kernels stream that run
+ * 2.   Writing a nonzero to an implicit zero is an error, writing T() there is accepted and ignored
+ * 3.   Symmetric kernels use each stored element twice, once for its row and once mirrored for its column
+ * 4.   The whole matrix is one Block request, once n(n+1)/2 elements pass BlockConfig::dataSize words
+ *      it takes a dedicated arena of the pool
+ */
+
+#ifndef SAFEARRAY_STRUCTUREDMATRIX_H
+#define SAFEARRAY_STRUCTUREDMATRIX_H
+#ifndef SAFEARRAY_STRUCTUREDMATRIX_DEBUG
+#define SAFEARRAY_STRUCTUREDMATRIX_DEBUG true
+#endif
+
+#include <algorithm>
+#include <vector>
+#include "SafeMatrix.h"
+
+template <typename T>
+class StructuredMatrix {
+public:
+    enum Structure { SYMMETRIC, LOWER, UPPER, BANDED };
+
+    // element of a non const matrix, assignments to an implicit zero are checked
+    class Element {
+    private:
+        T * element;
+        int row, col;
+
+    public:
+        Element(T * l_element, int l_row, int l_col) : element(l_element), row(l_row), col(l_col) { }
+
+        operator T() const {
+            return element ? * element : T();
+        }
+
+        Element & operator=(const T & value) {
+            if (element) {
+                * element = value;
+            } else if (!(value == T())) {
+                if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                    std::cout << "Index selector error: implicit zero " << row << "," << col << std::endl;
+                }
+                exit(1);
+            }
+            return * this;
+        }
+
+        Element & operator=(const Element & l_Element) {
+            return * this = (T) l_Element;
+        }
+
+        Element & operator+=(const T & value) {
+            return * this = (T) * this + value;
+        }
+
+        Element & operator-=(const T & value) {
+            return * this = (T) * this - value;
+        }
+    };
+
+    // row of a StructuredMatrix allowing "a[row][column]"
+    template <typename Matrix, typename Result>
+    class Row {
+    private:
+        Matrix * matrix;
+        int row;
+
+    public:
+        Row(Matrix * l_matrix, int l_row) : matrix(l_matrix), row(l_row) { }
+
+        Result operator[](int index) const {
+            matrix->check(index);
+            T * _element = matrix->locate(row - matrix->low, index - matrix->low);
+            return Result(_element, row, index);
+        }
+    };
+
+private:
+    // read only element, an implicit zero reads as T()
+    class Value {
+    private:
+        const T * element;
+
+    public:
+        Value(const T * l_element, int, int) : element(l_element) { }
+
+        operator T() const {
+            return element ? * element : T();
+        }
+    };
+
+    int low, high;
+    Structure structure;
+    // diagonals below and above the main one that a BANDED matrix stores
+    int lower = 0, upper = 0;
+    Block<T> * array = nullptr;
+
+public:
+    // construct an n by n matrix over indices 0.."l_high"
+    explicit StructuredMatrix(int l_high, Structure l_structure)
+            : StructuredMatrix(0, l_high, l_structure) { }
+
+    // construct a matrix over indices "l_low".."l_high" for both rows and columns
+    explicit StructuredMatrix(int l_low, int l_high, Structure l_structure)
+            : low(l_low), high(l_high), structure(l_structure) {
+        // a BANDED matrix without explicit widths is the diagonal
+        allocate();
+    }
+
+    // construct a BANDED matrix with "l_lower" diagonals below the main one and "l_upper" above it
+    explicit StructuredMatrix(int l_low, int l_high, int l_lower, int l_upper)
+            : low(l_low), high(l_high), structure(BANDED), lower(l_lower), upper(l_upper) {
+        if (lower < 0 || upper < 0) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Constructor error: band definition " << lower << " " << upper << std::endl;
+            }
+            exit(1);
+        }
+        int n = high - low + 1;
+        lower = std::min(lower, std::max(n - 1, 0));
+        upper = std::min(upper, std::max(n - 1, 0));
+        allocate();
+    }
+
+    // pack the elements of a square SafeMatrix that "l_structure" keeps, SYMMETRIC keeps the lower triangle
+    explicit StructuredMatrix(const SafeMatrix<T> & l_SafeMatrix, Structure l_structure)
+            : StructuredMatrix(l_SafeMatrix.rowLow, l_SafeMatrix.rowHigh, l_structure) {
+        pack(l_SafeMatrix);
+    }
+
+    explicit StructuredMatrix(const SafeMatrix<T> & l_SafeMatrix, int l_lower, int l_upper)
+            : StructuredMatrix(l_SafeMatrix.rowLow, l_SafeMatrix.rowHigh, l_lower, l_upper) {
+        pack(l_SafeMatrix);
+    }
+
+    // copy constructor
+    StructuredMatrix(const StructuredMatrix & l_StructuredMatrix)
+            : low(l_StructuredMatrix.low), high(l_StructuredMatrix.high), structure(l_StructuredMatrix.structure),
+              lower(l_StructuredMatrix.lower), upper(l_StructuredMatrix.upper) {
+        allocate();
+        std::copy(l_StructuredMatrix.array->data, l_StructuredMatrix.array->data + storage(), array->data);
+    }
+
+    ~ StructuredMatrix() {
+        delete array;
+    }
+
+    // overload the = operator to allow "StructuredMatrix<T> a = b;"
+    StructuredMatrix & operator=(const StructuredMatrix & l_StructuredMatrix) {
+        if (this == & l_StructuredMatrix) return * this;
+        delete array;
+        low = l_StructuredMatrix.low;
+        high = l_StructuredMatrix.high;
+        structure = l_StructuredMatrix.structure;
+        lower = l_StructuredMatrix.lower;
+        upper = l_StructuredMatrix.upper;
+        allocate();
+        std::copy(l_StructuredMatrix.array->data, l_StructuredMatrix.array->data + storage(), array->data);
+        return * this;
+    }
+
+    int getLow() const {
+        return low;
+    }
+
+    int getHigh() const {
+        return high;
+    }
+
+    Structure getStructure() const {
+        return structure;
+    }
+
+    int lowerBandwidth() const {
+        switch (structure) {
+            case BANDED: return lower;
+            case UPPER: return 0;
+            default: return high - low;
+        }
+    }
+
+    int upperBandwidth() const {
+        switch (structure) {
+            case BANDED: return upper;
+            case LOWER: return 0;
+            default: return high - low;
+        }
+    }
+
+    // number of stored elements
+    std::size_t storage() const {
+        std::size_t n = high - low + 1;
+        return structure == BANDED ? n * (lower + upper + 1) : n * (n + 1) / 2;
+    }
+
+    // every stored element becomes "element", implicit zeros stay zero
+    void fillMatrix(T element) {
+        std::fill(array->data, array->data + storage(), element);
+    }
+
+    // overload the [] operator to allow "a[row][column] = T();"
+    Row<StructuredMatrix, Element> operator[](int index) {
+        check(index);
+        return Row<StructuredMatrix, Element>(this, index);
+    }
+
+    Row<const StructuredMatrix, Value> operator[](int index) const {
+        check(index);
+        return Row<const StructuredMatrix, Value>(this, index);
+    }
+
+    // SafeArray y = a * x, "x" must have as many elements as the matrix has columns, y has the row bounds
+    SafeArray<T> operator*(const SafeArray<T> & l_SafeArray) const {
+        int n = high - low + 1;
+        if (l_SafeArray.getHigh() - l_SafeArray.getLow() + 1 != n) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Arithmetic error: structured matrix vector multiplication " << n << " "
+                          << l_SafeArray.getHigh() - l_SafeArray.getLow() + 1 << std::endl;
+            }
+            exit(1);
+        }
+        SafeArray<T> _result(low, high);
+        multiplyVector(l_SafeArray.constData(), _result.data());
+        return _result;
+    }
+
+    // "l_result" = a * "l_SafeMatrix" for a dense right hand side with n rows
+    void multiply(const SafeMatrix<T> & l_SafeMatrix, SafeMatrix<T> & l_result) const {
+        int n = high - low + 1;
+        int cols = l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1;
+        if (l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1 != n
+            || l_result.rowHigh - l_result.rowLow + 1 != n || l_result.colHigh - l_result.colLow + 1 != cols) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Arithmetic error: structured matrix multiplication " << n << " "
+                          << l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1 << "," << cols << " "
+                          << l_result.rowHigh - l_result.rowLow + 1 << ","
+                          << l_result.colHigh - l_result.colLow + 1 << std::endl;
+            }
+            exit(1);
+        }
+        if (& l_SafeMatrix == & l_result) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Arithmetic error: structured matrix multiplication in place" << std::endl;
+            }
+            exit(1);
+        }
+        std::vector<const T *> b(n);
+        std::vector<T *> c(n);
+        for (int row = 0; row < n; row++) {
+            b[row] = l_SafeMatrix.matrix[row]->constData();
+            c[row] = l_result.rows()[row]->data();
+            std::fill(c[row], c[row] + cols, T());
+        }
+        multiplyMatrix(b.data(), c.data(), cols);
+    }
+
+    // dense copy into a SafeMatrix with the same bounds
+    void expand(SafeMatrix<T> & l_result) const {
+        int n = high - low + 1;
+        if (l_result.rowHigh - l_result.rowLow + 1 != n || l_result.colHigh - l_result.colLow + 1 != n) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Arithmetic error: structured matrix expansion " << n << " "
+                          << l_result.rowHigh - l_result.rowLow + 1 << ","
+                          << l_result.colHigh - l_result.colLow + 1 << std::endl;
+            }
+            exit(1);
+        }
+        for (int row = 0; row < n; row++) {
+            T * _row = l_result.rows()[row]->data();
+            for (int col = 0; col < n; col++) {
+                const T * _element = locate(row, col);
+                _row[col] = _element ? * _element : T();
+            }
+        }
+    }
+
+    friend std::ostream & operator<<(std::ostream & l_ostream, const StructuredMatrix & l_StructuredMatrix) {
+        int n = l_StructuredMatrix.high - l_StructuredMatrix.low + 1;
+        for (int row = 0; row < n; row++) {
+            for (int col = 0; col < n; col++) {
+                const T * _element = l_StructuredMatrix.locate(row, col);
+                l_ostream << (_element ? * _element : T()) << "\t";
+            }
+            l_ostream << '\n';
+        }
+        return l_ostream;
+    }
+
+private:
+    void allocate() {
+        if (high - low < 0) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Constructor error: bounds definition" << std::endl;
+            }
+            exit(1);
+        }
+        array = new (storage() * sizeof(T)) Block<T>;
+        if (!array) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Constructor error: block allocation " << storage() * sizeof(T) << std::endl;
+            }
+            exit(1);
+        }
+        std::fill(array->data, array->data + storage(), T());
+    }
+
+    void pack(const SafeMatrix<T> & l_SafeMatrix) {
+        int n = high - low + 1;
+        if (l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1 != n) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Constructor error: structured matrix from " << n << ","
+                          << l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1 << std::endl;
+            }
+            exit(1);
+        }
+        for (int row = 0; row < n; row++) {
+            const T * _row = l_SafeMatrix.matrix[row]->constData();
+            std::copy(_row + first(row), _row + last(row) + 1, cells(row));
+        }
+    }
+
+    void check(int index) const {
+        if (index < low || index > high) {
+            if (SAFEARRAY_STRUCTUREDMATRIX_DEBUG) {
+                std::cout << "Index selector error: bounds selection " << index << " in " << low << "-" << high
+                          << std::endl;
+            }
+            exit(1);
+        }
+    }
+
+    // first and last stored column of row "i", zero based
+    int first(int i) const {
+        switch (structure) {
+            case UPPER: return i;
+            case BANDED: return std::max(0, i - lower);
+            default: return 0;
+        }
+    }
+
+    int last(int i) const {
+        switch (structure) {
+            case UPPER: return high - low;
+            case BANDED: return std::min(high - low, i + upper);
+            default: return i;
+        }
+    }
+
+    // storage of row "i" from column first(i) on
+    T * cells(int i) const {
+        int n = high - low + 1;
+        switch (structure) {
+            case UPPER: return array->data + (std::size_t) i * n - (std::size_t) i * (i - 1) / 2;
+            case BANDED: return array->data + (std::size_t) i * (lower + upper + 1) + (first(i) - (i - lower));
+            default: return array->data + (std::size_t) i * (i + 1) / 2;
+        }
+    }
+
+    // stored element at zero based ("i", "j"), nullptr for an implicit zero
+    T * locate(int i, int j) const {
+        if (structure == SYMMETRIC && j > i) std::swap(i, j);
+        if (j < first(i) || j > last(i)) return nullptr;
+        return cells(i) + (j - first(i));
+    }
+
+    // y = a * x over raw storage
+    void multiplyVector(const T * x, T * y) const {
+        int n = high - low + 1;
+        if (structure == SYMMETRIC) {
+            std::fill(y, y + n, T());
+            for (int i = 0; i < n; i++) {
+                const T * _a = cells(i);
+                const T _xi = x[i];
+                T _sum = _a[i] * _xi;
+                for (int j = 0; j < i; j++) {
+                    _sum += _a[j] * x[j];
+                    y[j] += _a[j] * _xi;
+                }
+                y[i] += _sum;
+            }
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            int _first = first(i), _last = last(i);
+            const T * _a = cells(i) - _first;
+            T _sum = T();
+            for (int j = _first; j <= _last; j++) {
+                _sum += _a[j] * x[j];
+            }
+            y[i] = _sum;
+        }
+    }
+
+    // c += a * b for "cols" columns, i-p-j order so the innermost loop streams rows of b and c
+    void multiplyMatrix(const T * const * b, T * const * c, int cols) const {
+        int n = high - low + 1;
+        for (int i = 0; i < n; i++) {
+            int _first = first(i), _last = last(i);
+            const T * _a = cells(i) - _first;
+            T * _ci = c[i];
+            for (int p = _first; p <= _last; p++) {
+                const T _aip = _a[p];
+                const T * _bp = b[p];
+                for (int j = 0; j < cols; j++) {
+                    _ci[j] += _aip * _bp[j];
+                }
+                if (structure == SYMMETRIC && p < i) {
+                    // the same element is a[p][i]
+                    T * _cp = c[p];
+                    const T * _bi = b[i];
+                    for (int j = 0; j < cols; j++) {
+                        _cp[j] += _aip * _bi[j];
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif //SAFEARRAY_STRUCTUREDMATRIX_H
@@ -0,0 +1,275 @@
+/*
+ * TextIO class writes SafeArray, SafeMatrix and VNT storage as CSV or TSV text and reads it back
+ *
+ * Numbers go through std::to_chars and std::from_chars: no locale, no stream state and the shortest text
+ * that reads back to the same value, so write() then read() restores every element exactly.
+ *
+ * Details:
+ *
+ * 1.   write() formats slices of about SLICE elements on separate threads into buffers reused across
+ *      batches, then hands the buffers to the stream in order, one write per slice and no flush
+ * 2.   read() maps the file, finds the line ends of CHUNK byte pieces in parallel, then parses the lines
+ *      in parallel straight into the rows of the new SafeMatrix
+ * 3.   One row per line, fields separated by "separator" with optional spaces around them,
+ *      "\r\n" line ends and a missing last line end are accepted, quoted fields are not
+ * 4.   read() detects the separator from the first line when none is given: a tab makes it TSV, otherwise CSV
+ * 5.   Every line must hold the same number of fields, the first bad line is reported and nothing is read
+ * 6.   Rows wider than a block take dedicated arenas, more narrow rows than one arena holds need a Block pool
+ *      allowed to grow (BlockConfig::maxArenas)
+ */
+
+#ifndef SAFEARRAY_TEXTIO_H
+#define SAFEARRAY_TEXTIO_H
+#ifndef SAFEARRAY_TEXTIO_DEBUG
+#define SAFEARRAY_TEXTIO_DEBUG true
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "VNT.h"
+#include "Parallel.h"
+
+template <typename T>
+class TextIO {
+    static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                  "TextIO elements must be integer or floating point numbers");
+
+private:
+    // elements formatted or parsed by one thread at a time, bytes searched for line ends by one thread
+    enum { SLICE = 65536, CHUNK = 1 << 20 };
+    // longest to_chars text of any element type, a shortest round trip double needs 24
+    enum { FIELD = 32 };
+
+public:
+    // write "l_SafeMatrix" to "l_path" one row per line, returns false on failure
+    static bool write(const std::string & l_path, const SafeMatrix<T> & l_SafeMatrix, char l_separator = ',',
+                      int l_threads = 0) {
+        std::ofstream _out(l_path, std::ios::binary | std::ios::trunc);
+        if (!_out) {
+            if (SAFEARRAY_TEXTIO_DEBUG) std::cout << "File error: open " << l_path << std::endl;
+            return false;
+        }
+        write(_out, l_SafeMatrix, l_separator, l_threads);
+        _out.close();
+        if (!_out) {
+            if (SAFEARRAY_TEXTIO_DEBUG) std::cout << "File error: write " << l_path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static bool write(std::ostream & l_ostream, const SafeMatrix<T> & l_SafeMatrix, char l_separator = ',',
+                      int l_threads = 0) {
+        long cols = l_SafeMatrix.colHigh - l_SafeMatrix.colLow + 1;
+        return writeRows(l_ostream, l_SafeMatrix.rowHigh - l_SafeMatrix.rowLow + 1, cols, l_threads,
+                         [&](long l_row, char * l_text) {
+                             return formatRow(l_text, l_SafeMatrix.matrix[l_row]->constData(), cols, cols,
+                                              l_separator);
+                         });
+    }
+
+    // "l_SafeArray" as a single line
+    static bool write(std::ostream & l_ostream, const SafeArray<T> & l_SafeArray, char l_separator = ',') {
+        long cols = l_SafeArray.getHigh() - l_SafeArray.getLow() + 1;
+        if (cols <= 0) return (bool) l_ostream;
+        const T * _data = l_SafeArray.constData();
+        return writeRows(l_ostream, 1, cols, 1, [&](long, char * l_text) {
+            return formatRow(l_text, _data, cols, cols, l_separator);
+        });
+    }
+
+    // the table of "l_VNT", empty cells as "--" like operator<<
+    template <typename Compare>
+    static bool write(std::ostream & l_ostream, const VNT<T, Compare> & l_VNT, char l_separator = ',',
+                      int l_threads = 0) {
+        const SafeMatrix<T> & _table = * l_VNT.table;
+        long cols = _table.colHigh - _table.colLow + 1;
+        return writeRows(l_ostream, _table.rowHigh - _table.rowLow + 1, cols, l_threads,
+                         [&](long l_row, char * l_text) {
+                             return formatRow(l_text, _table.matrix[l_row]->constData(), l_VNT.rowFill(l_row),
+                                              cols, l_separator);
+                         });
+    }
+
+    /*
+     * read the CSV or TSV file at "l_path" into "l_result", indexed from "l_rowLow" and "l_colLow"
+     * "l_separator" 0 detects it from the first line, returns false and leaves "l_result" alone on failure
+     */
+    static bool read(const std::string & l_path, SafeMatrix<T> & l_result, int l_rowLow = 0, int l_colLow = 0,
+                     char l_separator = 0, int l_threads = 0) {
+        int _fd = ::open(l_path.c_str(), O_RDONLY);
+        if (_fd < 0) {
+            if (SAFEARRAY_TEXTIO_DEBUG) std::cout << "File error: open " << l_path << std::endl;
+            return false;
+        }
+        struct stat _stat;
+        if (fstat(_fd, & _stat) != 0 || _stat.st_size == 0) {
+            if (SAFEARRAY_TEXTIO_DEBUG) std::cout << "File error: empty " << l_path << std::endl;
+            ::close(_fd);
+            return false;
+        }
+        std::size_t _size = _stat.st_size;
+        void * _mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+        // the mapping keeps its own reference to the file
+        ::close(_fd);
+        if (_mapping == MAP_FAILED) {
+            if (SAFEARRAY_TEXTIO_DEBUG) std::cout << "File error: mmap " << l_path << std::endl;
+            return false;
+        }
+        madvise(_mapping, _size, MADV_SEQUENTIAL);
+        bool _success = parse(static_cast<const char *>(_mapping), _size, l_path, l_result, l_rowLow, l_colLow,
+                              l_separator, Parallel::threads(l_threads));
+        munmap(_mapping, _size);
+        return _success;
+    }
+
+private:
+    // "l_format(row, text)" writes row "row" at "text" and returns its end, at most cols * (FIELD + 1) bytes
+    template <typename Format>
+    static bool writeRows(std::ostream & l_ostream, long l_rows, long l_cols, int l_threads,
+                          const Format & l_format) {
+        if (l_rows <= 0 || l_cols <= 0) return (bool) l_ostream;
+        int _threads = Parallel::threads(l_threads);
+        long _sliceRows = std::max<long>(1, SLICE / l_cols);
+        long _slices = (l_rows + _sliceRows - 1) / _sliceRows;
+        std::vector<std::vector<char>> _buffers(std::min<long>(_threads, _slices));
+        std::vector<std::size_t> _used(_buffers.size());
+        for (long first = 0; first < _slices; first += _buffers.size()) {
+            long _batch = std::min<long>(_buffers.size(), _slices - first);
+            Parallel::forRange(0, _batch, _threads, 1, [&](long l_low, long l_high) {
+                for (long slice = l_low; slice < l_high; slice++) {
+                    long _begin = (first + slice) * _sliceRows;
+                    long _end = std::min(l_rows, _begin + _sliceRows);
+                    std::vector<char> & _buffer = _buffers[slice];
+                    _buffer.resize((_end - _begin) * l_cols * (FIELD + 1));
+                    char * _text = _buffer.data();
+                    for (long row = _begin; row < _end; row++) {
+                        _text = l_format(row, _text);
+                    }
+                    _used[slice] = _text - _buffer.data();
+                }
+            });
+            for (long slice = 0; slice < _batch; slice++) {
+                l_ostream.write(_buffers[slice].data(), _used[slice]);
+            }
+        }
+        return (bool) l_ostream;
+    }
+
+    // the first "l_filled" of "l_cols" elements, the rest as "--", ends with a line end
+    static char * formatRow(char * l_text, const T * l_row, long l_filled, long l_cols, char l_separator) {
+        for (long col = 0; col < l_cols; col++) {
+            if (col < l_filled) {
+                l_text = std::to_chars(l_text, l_text + FIELD, l_row[col]).ptr;
+            } else {
+                * l_text++ = '-';
+                * l_text++ = '-';
+            }
+            * l_text++ = col + 1 < l_cols ? l_separator : '\n';
+        }
+        return l_text;
+    }
+
+    static bool parse(const char * l_text, std::size_t l_size, const std::string & l_path, SafeMatrix<T> & l_result,
+                      int l_rowLow, int l_colLow, char l_separator, int l_threads) {
+        // line ends of every chunk, found in parallel and joined in order
+        long _chunks = (l_size + CHUNK - 1) / CHUNK;
+        std::vector<std::vector<long>> _ends(_chunks);
+        Parallel::forRange(0, _chunks, l_threads, 1, [&](long l_low, long l_high) {
+            for (long chunk = l_low; chunk < l_high; chunk++) {
+                const char * _end = l_text + std::min<std::size_t>(l_size, (chunk + 1) * (std::size_t) CHUNK);
+                for (const char * _line = l_text + chunk * CHUNK;
+                     (_line = static_cast<const char *>(memchr(_line, '\n', _end - _line))); _line++) {
+                    _ends[chunk].push_back(_line - l_text);
+                }
+            }
+        });
+        // starts[i]..starts[i + 1] - 1 is line i and its line end
+        std::vector<long> _starts(1, 0);
+        for (const std::vector<long> & ends : _ends) {
+            for (long end : ends) _starts.push_back(end + 1);
+        }
+        if (_starts.back() != (long) l_size) _starts.push_back(l_size + 1);
+        // trailing empty lines are ignored
+        while (_starts.size() > 1 && lineEnd(l_text, _starts[_starts.size() - 2], _starts.back())
+                                     == l_text + _starts[_starts.size() - 2]) {
+            _starts.pop_back();
+        }
+        long _rows = _starts.size() - 1;
+        if (_rows <= 0) {
+            if (SAFEARRAY_TEXTIO_DEBUG) std::cout << "File error: empty " << l_path << std::endl;
+            return false;
+        }
+
+        const char * _first = l_text;
+        const char * _firstEnd = lineEnd(l_text, 0, _starts[1]);
+        char _separator = l_separator ? l_separator : std::find(_first, _firstEnd, '\t') != _firstEnd ? '\t' : ',';
+        long _cols = std::count(_first, _firstEnd, _separator) + 1;
+        if ((long) l_rowLow + _rows - 1 > INT_MAX || (long) l_colLow + _cols - 1 > INT_MAX) {
+            if (SAFEARRAY_TEXTIO_DEBUG) std::cout << "File error: bounds definition " << l_path << std::endl;
+            return false;
+        }
+
+        SafeMatrix<T> _matrix(l_rowLow, l_rowLow + _rows - 1, l_colLow, l_colLow + _cols - 1);
+        std::vector<T *> _rowData(_rows);
+        for (long row = 0; row < _rows; row++) {
+            _rowData[row] = _matrix.rows()[row]->data();
+        }
+        std::atomic<long> _error(LONG_MAX);
+        Parallel::forRange(0, _rows, l_threads, std::max<long>(1, SLICE / _cols), [&](long l_low, long l_high) {
+            for (long row = l_low; row < l_high; row++) {
+                if (!parseLine(l_text + _starts[row], lineEnd(l_text, _starts[row], _starts[row + 1]), _separator,
+                               _rowData[row], _cols)) {
+                    long _seen = _error.load();
+                    while (row < _seen && !_error.compare_exchange_weak(_seen, row)) { }
+                    return;
+                }
+            }
+        });
+        if (_error.load() != LONG_MAX) {
+            if (SAFEARRAY_TEXTIO_DEBUG) {
+                std::cout << "File error: parse " << l_path << " line " << _error.load() + 1 << std::endl;
+            }
+            return false;
+        }
+        l_result = _matrix;
+        return true;
+    }
+
+    // end of the line "l_start".."l_next" - 1 without its "\n" or "\r\n"
+    static const char * lineEnd(const char * l_text, long l_start, long l_next) {
+        const char * _end = l_text + l_next - 1;
+        if (_end > l_text + l_start && _end[-1] == '\r') _end--;
+        return _end;
+    }
+
+    // exactly "l_cols" numbers separated by "l_separator" into "l_row"
+    static bool parseLine(const char * l_text, const char * l_end, char l_separator, T * l_row, long l_cols) {
+        bool _spaces = l_separator != ' ';
+        for (long col = 0; col < l_cols; col++) {
+            while (_spaces && l_text < l_end && * l_text == ' ') l_text++;
+            std::from_chars_result _result = std::from_chars(l_text, l_end, l_row[col]);
+            if (_result.ec != std::errc()) return false;
+            l_text = _result.ptr;
+            while (_spaces && l_text < l_end && * l_text == ' ') l_text++;
+            if (col + 1 < l_cols) {
+                if (l_text == l_end || * l_text != l_separator) return false;
+                l_text++;
+            }
+        }
+        return l_text == l_end;
+    }
+};
+
+#endif //SAFEARRAY_TEXTIO_H
@@ -0,0 +1,283 @@
+/*
+ * Trace class records timestamped events into per thread ring buffers and exports them as Chrome trace events
+ *
+ * Tracing is compiled in with "#define SAFEARRAY_TRACE true" (or -DSAFEARRAY_TRACE=true) before any include.
+ * Hooks are written as "if (SAFEARRAY_TRACE)", so with the default false they compile to nothing.
+ *
+ * Details:
+ *
+ * 1.   Every thread owns a ring buffer, only that thread writes it, no locks and no atomics read-modify-write
+ * 2.   A full ring overwrites its oldest events
+ * 3.   Timestamps are TSC ticks on x86-64, converted to time when flushed, steady_clock elsewhere
+ * 4.   Events are 32 bytes: time, an event kind from the table below and up to three integer arguments
+ * 5.   flush() copies every ring, skips events overwritten while copying and writes JSON for chrome://tracing
+ *      or ui.perfetto.dev; buffers of finished threads are kept until flushed
+ * 6.   Slots are four relaxed atomic words, plain stores on x86-64, so flush() may read a ring while its
+ *      thread writes it; fences order each slot against the head like a sequence lock
+ * 7.   An event costs the timestamp plus a few ns, reading the TSC takes about 7 ns on bare metal but
+ *      several times that under hypervisors that trap it
+ */
+
+#ifndef SAFEARRAY_TRACE_H
+#define SAFEARRAY_TRACE_H
+#ifndef SAFEARRAY_TRACE
+#define SAFEARRAY_TRACE false
+#endif
+#ifndef SAFEARRAY_TRACE_CAPACITY
+#define SAFEARRAY_TRACE_CAPACITY (1 << 16)
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+class Trace {
+public:
+    // kinds of event, names and argument labels are in point()
+    enum Event {
+        ALLOCATE, FREE,
+        MATRIX_ADD, MATRIX_SUBTRACT, MATRIX_MULTIPLY, KERNEL_MULTIPLY,
+        VNT_ADD, VNT_EXTRACT, VNT_FIND, VNT_REMOVE, VNT_BUILD, VNT_SELECT, VNT_MERGE,
+        EVENTS
+    };
+
+    // records "l_event" begin now and its end when the scope closes
+    class Scope {
+    private:
+        Event event;
+
+    public:
+        Scope(Event l_event, uint64_t a = 0, uint32_t b = 0, uint32_t c = 0) : event(l_event) {
+            if (SAFEARRAY_TRACE)
+                record(event, 'B', a, b, c);
+        }
+
+        ~Scope() {
+            if (SAFEARRAY_TRACE)
+                record(event, 'E', 0, 0, 0);
+        }
+
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+    };
+
+    // records a zero length event such as an allocation
+    static inline void instant(Event l_event, uint64_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        record(l_event, 'i', a, b, c);
+    }
+
+    static inline void record(Event l_event, char l_phase, uint64_t a, uint32_t b, uint32_t c) {
+        Buffer & _buffer = local();
+        uint64_t _head = _buffer.head.load(std::memory_order_relaxed);
+        // the head published for the last event is ordered before every word of this one, see copy()
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot & _slot = _buffer.slots[_head & (CAPACITY - 1)];
+        _slot.time.store(now(), std::memory_order_relaxed);
+        _slot.a.store(a, std::memory_order_relaxed);
+        _slot.bc.store(b | (uint64_t) c << 32, std::memory_order_relaxed);
+        _slot.kind.store(l_event | (uint64_t) (unsigned char) l_phase << 16, std::memory_order_relaxed);
+        // publish after the slot is written, flush() reads head with acquire
+        _buffer.head.store(_head + 1, std::memory_order_release);
+    }
+
+    /*
+     * writes every event recorded since the last flush as Chrome trace-event JSON and empties the buffers
+     * false if "l_path" cannot be written
+     */
+    static bool flush(const char * l_path) {
+        std::ofstream _file(l_path);
+        if (!_file) return false;
+        flush(_file);
+        return (bool) _file;
+    }
+
+    static void flush(std::ostream & l_ostream) {
+        Registry & _registry = registry();
+        std::lock_guard<std::mutex> _guard(_registry.lock);
+        double _nanoseconds = nanosecondsPerTick(_registry);
+        l_ostream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool _first = true;
+        for (std::shared_ptr<Buffer> & buffer : _registry.buffers) {
+            l_ostream << (_first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                      << buffer->thread << ",\"args\":{\"name\":\"thread " << buffer->thread << "\"}}";
+            _first = false;
+            std::vector<Record> _records;
+            copy(* buffer, _records);
+            for (const Record & record : _records) {
+                write(l_ostream, record, buffer->thread, _nanoseconds, _registry.start);
+            }
+        }
+        l_ostream << "\n]}\n";
+    }
+
+    // drops every recorded event
+    static void clear() {
+        Registry & _registry = registry();
+        std::lock_guard<std::mutex> _guard(_registry.lock);
+        for (std::shared_ptr<Buffer> & buffer : _registry.buffers) {
+            buffer->tail = buffer->head.load(std::memory_order_acquire);
+        }
+    }
+
+private:
+    enum { CAPACITY = SAFEARRAY_TRACE_CAPACITY };
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SAFEARRAY_TRACE_CAPACITY must be a power of two");
+
+    struct Record {
+        uint64_t time;
+        uint64_t a;
+        uint32_t b, c;
+        uint16_t event;
+        char phase;
+    };
+
+    // a Record as the owning thread writes it, "bc" holds b and c, "kind" the event and phase
+    struct Slot {
+        std::atomic<uint64_t> time, a, bc, kind;
+    };
+
+    // name, category and labels of the arguments a, b and c (nullptr when unused)
+    struct Point {
+        const char * name;
+        const char * category;
+        const char * label[3];
+    };
+
+    struct Buffer {
+        Slot slots[CAPACITY];
+        std::atomic<uint64_t> head{0};
+        // first record not yet flushed, only used under the registry lock
+        uint64_t tail = 0;
+        int thread = 0;
+    };
+
+    struct Registry {
+        std::mutex lock;
+        std::vector<std::shared_ptr<Buffer>> buffers;
+        uint64_t start = now();
+        std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+    };
+
+    static const Point & point(uint16_t l_event) {
+        static const Point _points[EVENTS] = {
+                { "allocate", "block", { "address", "bytes", nullptr } },
+                { "free", "block", { "address", nullptr, nullptr } },
+                { "SafeMatrix::operator+", "matrix", { "rows", "cols", nullptr } },
+                { "SafeMatrix::operator-", "matrix", { "rows", "cols", nullptr } },
+                { "SafeMatrix::operator*", "matrix", { "m", "k", "n" } },
+                { "MatrixKernel::multiplyAdd", "matrix", { "m", "n", "k" } },
+                { "VNT::add", "vnt", { "size", "rows", "cols" } },
+                { "VNT::extractMin", "vnt", { "size", "rows", "cols" } },
+                { "VNT::find", "vnt", { "size", "rows", "cols" } },
+                { "VNT::remove", "vnt", { "size", "rows", "cols" } },
+                { "VNT::build", "vnt", { "size", "rows", "cols" } },
+                { "VNT::kthSmallest", "vnt", { "size", "rank", nullptr } },
+                { "VNT::merge", "vnt", { "size", "other", nullptr } }
+        };
+        return _points[l_event];
+    }
+
+    static Registry & registry() {
+        static Registry _registry;
+        return _registry;
+    }
+
+    // the calling thread's buffer, created and registered on first use
+    // a plain pointer is constant initialized, so the common path needs no thread_local guard
+    static inline Buffer & local() {
+        static thread_local Buffer * _buffer = nullptr;
+        if (!_buffer) _buffer = enroll();
+        return * _buffer;
+    }
+
+    // the registry owns every buffer, so events of finished threads survive until flushed
+    static Buffer * enroll() {
+        Registry & _registry = registry();
+        std::shared_ptr<Buffer> _buffer = std::make_shared<Buffer>();
+        std::lock_guard<std::mutex> _guard(_registry.lock);
+        _buffer->thread = (int) _registry.buffers.size() + 1;
+        _registry.buffers.push_back(_buffer);
+        return _buffer.get();
+    }
+
+    static inline uint64_t now() {
+#if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // tick length measured against steady_clock since the registry was created
+    static double nanosecondsPerTick(Registry & l_registry) {
+#if defined(__x86_64__) || defined(_M_X64)
+        double _ticks = (double) (now() - l_registry.start);
+        double _nanoseconds = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - l_registry.clockStart).count();
+        return _ticks > 0 ? _nanoseconds / _ticks : 1;
+#else
+        (void) l_registry;
+        return 1;
+#endif
+    }
+
+    /*
+     * copy the unflushed records of "l_buffer", its thread may still be writing:
+     * records up to head - CAPACITY after the copy may have been overwritten during it and are dropped,
+     * the slot of head - CAPACITY is the one the thread writes next.
+     * A word read from an event written during the copy makes the acquire fence see that event's head,
+     * so the second head read never misses an overwrite.
+     */
+    static void copy(Buffer & l_buffer, std::vector<Record> & l_records) {
+        uint64_t _head = l_buffer.head.load(std::memory_order_acquire);
+        uint64_t _first = std::max(l_buffer.tail, _head > CAPACITY ? _head - CAPACITY : 0);
+        l_records.reserve(_head - _first);
+        for (uint64_t index = _first; index < _head; index++) {
+            const Slot & _slot = l_buffer.slots[index & (CAPACITY - 1)];
+            uint64_t _bc = _slot.bc.load(std::memory_order_relaxed);
+            uint64_t _kind = _slot.kind.load(std::memory_order_relaxed);
+            l_records.push_back({ _slot.time.load(std::memory_order_relaxed), _slot.a.load(std::memory_order_relaxed),
+                                  (uint32_t) _bc, (uint32_t) (_bc >> 32), (uint16_t) _kind,
+                                  (char) (_kind >> 16) });
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t _after = l_buffer.head.load(std::memory_order_relaxed);
+        uint64_t _safe = _after >= CAPACITY ? _after - CAPACITY + 1 : 0;
+        if (_safe > _first) {
+            l_records.erase(l_records.begin(), l_records.begin() + std::min<uint64_t>(_safe - _first, l_records.size()));
+        }
+        l_buffer.tail = _head;
+    }
+
+    static void write(std::ostream & l_ostream, const Record & l_record, int l_thread, double l_nanoseconds,
+                      uint64_t l_start) {
+        const Point & _point = point(l_record.event);
+        // Chrome expects microseconds
+        double _time = l_record.time >= l_start ? (l_record.time - l_start) * l_nanoseconds / 1000 : 0;
+        l_ostream << ",\n{\"name\":\"" << _point.name << "\",\"cat\":\"" << _point.category << "\",\"ph\":\""
+                  << l_record.phase << "\",\"ts\":" << std::fixed << _time << std::defaultfloat
+                  << ",\"pid\":1,\"tid\":" << l_thread;
+        if (l_record.phase == 'i') l_ostream << ",\"s\":\"t\"";
+        if (l_record.phase != 'E' && _point.label[0]) {
+            const uint64_t _values[3] = { l_record.a, l_record.b, l_record.c };
+            l_ostream << ",\"args\":{";
+            for (int arg = 0; arg < 3 && _point.label[arg]; arg++) {
+                l_ostream << (arg ? "," : "") << "\"" << _point.label[arg] << "\":" << _values[arg];
+            }
+            l_ostream << "}";
+        }
+        l_ostream << "}";
+    }
+};
+
+#endif //SAFEARRAY_TRACE_H
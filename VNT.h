@@ -1,21 +1,51 @@
 /*
  * VNT(Very Neat Table) class is a m by n matrix such that the entries of each row are in sorted order from left to right
  * entries of each column are in sorted order from top(max) to bottom(min)
+ *
+ * Order is decided by "Compare" (std::less by default), so any type with a strict weak ordering works.
+ * The number of elements in every row is tracked, occupied cells always form a staircase at the top left.
+ *
+ * Occupancy:
+ * SENTINEL     empty cells hold _MAX and elements above _MAX are rejected, as in the original VNT
+ * ROWFILL      no sentinel value, empty cells are only known from the row counts
+ *
+ * A std::pmr::memory_resource given to the constructor holds the table elements and the row counts.
+ * A copy takes the resource of the table it copies, an assignment keeps the resource of the table assigned to.
  */
 
 #ifndef SAFEARRAY_VNT_H
 #define SAFEARRAY_VNT_H
+#ifndef SAFEARRAY_VNT_DEBUG
 #define SAFEARRAY_VNT_DEBUG true
+#endif
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <queue>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "SafeMatrix.h"
 
-template <typename T>
+template <typename T, typename Compare = std::less<T>>
 class VNT {
 public:
+    enum Occupancy { SENTINEL, ROWFILL };
+
     T _MAX;
     SafeMatrix<T> * table;
 
+private:
+    Compare compare;
+    bool sentinel = true;
+    // number of occupied cells in each row, never increasing from top to bottom
+    std::pmr::vector<int> fill;
+    int elements = 0;
+
 public:
 
     VNT() {
@@ -25,16 +55,38 @@ public:
     // creates a "n" by "n" table
     VNT(const int & n, const T & max) : _MAX(max) {
         table = new SafeMatrix<T>(n - 1);
-        table->fillMatrix(_MAX);
+        clear();
     }
 
     // creates a "m" by "n" table
     VNT(const int & m, const int & n, const T & max) : _MAX(max) {
         table = new SafeMatrix<T>(m - 1, n - 1);
-        table->fillMatrix(_MAX);
+        clear();
+    }
+
+    // creates a "m" by "n" table holding the "size" elements of "array" in one bottom up pass, see build()
+    VNT(const int & m, const int & n, const T & max, const T array[], int size) : _MAX(max) {
+        table = new SafeMatrix<T>(m - 1, n - 1);
+        build(array, size);
+    }
+
+    // creates a "m" by "n" table, SENTINEL uses the largest value of T under "Compare" as _MAX
+    VNT(const int & m, const int & n, Occupancy occupancy, std::pmr::memory_resource * l_resource = nullptr)
+            : _MAX(largestValue()), sentinel(occupancy == SENTINEL), fill(orDefault(l_resource)) {
+        table = new SafeMatrix<T>(0, m - 1, 0, n - 1, l_resource);
+        clear();
+    }
+
+    VNT(const int & m, const int & n, Occupancy occupancy, const T array[], int size,
+        std::pmr::memory_resource * l_resource = nullptr)
+            : _MAX(largestValue()), sentinel(occupancy == SENTINEL), fill(orDefault(l_resource)) {
+        table = new SafeMatrix<T>(0, m - 1, 0, n - 1, l_resource);
+        build(array, size);
     }
 
-    VNT(const VNT<T> & l_VNT) {
+    VNT(const VNT & l_VNT)
+            : compare(l_VNT.compare), sentinel(l_VNT.sentinel), fill(l_VNT.fill, l_VNT.fill.get_allocator()),
+              elements(l_VNT.elements) {
         _MAX = l_VNT._MAX;
         table = new SafeMatrix<T>(* l_VNT.table);
     }
@@ -43,117 +95,685 @@ public:
 
     // adds an "element" to the matrix
     void add(T element) {
-        int row = table->rowHigh;
-        int col = table->colHigh;
-        if ((* table)[row][col] != _MAX) {
+        Trace::Scope _trace(Trace::VNT_ADD, size(), table->rowHigh + 1, table->colHigh + 1);
+        if (elements == capacity()) {
             if (SAFEARRAY_VNT_DEBUG) {
                 std::cout << "insert error: table full " << element << std::endl;
             }
             return;
-        } else if (element > _MAX) {
+        } else if (sentinel && less(_MAX, element)) {
             if (SAFEARRAY_VNT_DEBUG) {
                 std::cout << "insert error: value limit " << element << std::endl;
             }
             return;
-        } else (* table)[row][col] = element;
-
-        while(row > 0 || col > 0) {
-            if (row > 0 && (* table)[row - 1][col] == _MAX) {
-                (* table)[row - 1][col] = element;
-                (* table)[row][col] = _MAX;
-                row--;
-            } else if (col > 0 && (* table)[row][col - 1] == _MAX) {
-                (* table)[row][col - 1] = element;
-                (* table)[row][col] = _MAX;
-                col--;
-            } else {
-                int left = 0;
-                int top = 0;
-                if (col > 0) {
-                    left += (* table)[row][col - 1];
-                }
-                if (row > 0) {
-                    top += (* table)[row - 1][col];
-                }
-                if (top >= left && (* table)[row - 1][col] > element) {
-                    T temp = (* table)[row - 1][col];
-                    (* table)[row - 1][col] = element;
-                    (* table)[row][col] = temp;
-                    row--;
-                    continue;
-                } else if (left > top && (* table)[row][col - 1] > element) {
-                    T temp = (* table)[row][col - 1];
-                    (* table)[row][col - 1] = element;
-                    (* table)[row][col] = temp;
-                    col--;
-                    continue;
-                }
-                break;
-            }
+        } else if (sentinel && !less(element, _MAX)) {
+            // _MAX marks an empty cell, adding it leaves the table as it is
+            return;
+        }
+
+        // the new cell ends the first row with room, every row above it is full
+        int _row = 0;
+        while (fill[_row] == table->colHigh + 1) _row++;
+        int _col = fill[_row];
+        fill[_row]++;
+        elements++;
+
+        // move the hole up or left past the larger neighbour while that neighbour is larger than "element"
+        while (_row > 0 || _col > 0) {
+            T * _up = _row > 0 ? row(_row - 1) + _col : nullptr;
+            T * _left = _col > 0 ? row(_row) + _col - 1 : nullptr;
+            T * _larger = !_up ? _left : !_left ? _up : less(* _up, * _left) ? _left : _up;
+            if (!less(element, * _larger)) break;
+            row(_row)[_col] = * _larger;
+            if (_larger == _up) _row--;
+            else _col--;
         }
+        row(_row)[_col] = element;
     }
 
     T getMin() {
-        return (* table)[0][0];
+        if (isEmpty()) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "min error: table empty" << std::endl;
+            }
+            exit(1);
+        }
+        return cells(0)[0];
+    }
+
+    // number of elements in the table
+    int size() const {
+        return elements;
+    }
+
+    int capacity() const {
+        return (table->rowHigh + 1) * (table->colHigh + 1);
+    }
+
+    // number of occupied cells in row "l_row" of the table, they are its first cells
+    int rowFill(int l_row) const {
+        return fill[l_row];
+    }
+
+    bool isEmpty() const {
+        return elements == 0;
+    }
+
+    // removes and returns the smallest element, the hole sinks to the bottom right in time proportional to m + n
+    T extractMin() {
+        Trace::Scope _trace(Trace::VNT_EXTRACT, size(), table->rowHigh + 1, table->colHigh + 1);
+        if (isEmpty()) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "extract error: table empty" << std::endl;
+            }
+            return _MAX;
+        }
+        T _min = row(0)[0];
+        sinkHole(0, 0);
+        return _min;
+    }
+
+    // removes and returns up to "k" smallest elements in sorted order
+    SafeArray<T> popN(int k) {
+        std::vector<T> _elements;
+        while ((int) _elements.size() < k && !isEmpty()) {
+            _elements.push_back(extractMin());
+        }
+        return toSafeArray(_elements);
+    }
+
+    /*
+     * returns up to "k" smallest elements in sorted order without changing the table
+     * a min heap holds the frontier: popping (row, col) pushes (row, col + 1), and (row + 1, col) when col is 0,
+     * so every cell enters the heap once and the cost is O(k log k)
+     */
+    SafeArray<T> topK(int k) {
+        typedef std::pair<T, std::pair<int, int>> Cell;
+        auto _greater = [this](const Cell & a, const Cell & b) { return less(b.first, a.first); };
+        std::priority_queue<Cell, std::vector<Cell>, decltype(_greater)> _frontier(_greater);
+        std::vector<T> _elements;
+        int rows = table->rowHigh + 1;
+        if (k > 0 && !isEmpty())
+            _frontier.push(Cell(cells(0)[0], std::make_pair(0, 0)));
+        while ((int) _elements.size() < k && !_frontier.empty()) {
+            Cell _cell = _frontier.top();
+            _frontier.pop();
+            _elements.push_back(_cell.first);
+            int _row = _cell.second.first;
+            int _col = _cell.second.second;
+            if (_col + 1 < fill[_row])
+                _frontier.push(Cell(cells(_row)[_col + 1], std::make_pair(_row, _col + 1)));
+            if (_col == 0 && _row + 1 < rows && fill[_row + 1] > 0)
+                _frontier.push(Cell(cells(_row + 1)[0], std::make_pair(_row + 1, 0)));
+        }
+        return toSafeArray(_elements);
+    }
+
+    // range whose iterator streams the elements in sorted order, extracting each one as it advances
+    class Drain {
+    private:
+        VNT * vnt;
+
+    public:
+        class iterator {
+        private:
+            VNT * vnt;
+
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef T value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const T * pointer;
+            typedef const T & reference;
+
+            explicit iterator(VNT * l_vnt) : vnt(l_vnt) { }
+
+            const T & operator*() const {
+                return vnt->cells(0)[0];
+            }
+
+            iterator & operator++() {
+                vnt->extractMin();
+                return * this;
+            }
+
+            // an iterator is at the end once the table is empty
+            bool operator==(const iterator & l_iterator) const {
+                return (vnt == nullptr || vnt->isEmpty()) == (l_iterator.vnt == nullptr || l_iterator.vnt->isEmpty());
+            }
+
+            bool operator!=(const iterator & l_iterator) const {
+                return !(* this == l_iterator);
+            }
+        };
+
+        explicit Drain(VNT * l_vnt) : vnt(l_vnt) { }
+
+        iterator begin() const {
+            return iterator(vnt);
+        }
+
+        iterator end() const {
+            return iterator(nullptr);
+        }
+    };
+
+    // allows "for (T element : table.drain())", the table is empty afterwards
+    Drain drain() {
+        return Drain(this);
     }
 
-    VNT<T> sort(T squareMatrix[], int size) {
+    VNT sort(T squareMatrix[], int size) {
         int n = sqrt(size);
+        std::pmr::memory_resource * _resource = table->getResource();
         delete table;
-        table = new SafeMatrix<T>(n - 1);
-        table->fillMatrix(_MAX);
-        for (int index = 0; index < size; index++) {
-            add(squareMatrix[index]);
-        }
+        table = new SafeMatrix<T>(0, n - 1, 0, n - 1, _resource);
+        build(squareMatrix, size);
         return * this;
     }
 
+    // single staircase walk from the bottom left corner in time proportional to m + n
     bool find(T element) {
-        int lRow = table->rowHigh;
-        int lCol = 0;
-        int rRow = 0;
-        int rCol = table->colHigh;
-        bool run = true;
-        while (run) {
-            if ((* table)[lRow][lCol] == element) return true;
-            if ((* table)[rRow][rCol] == element) return true;
-            if (lCol < table->colHigh && (* table)[lRow][lCol + 1] <= element) {
-                lCol++;
-                run = !run;
-            } else if (lRow > 0) {
-                lRow--;
-                run = !run;
-            }
-            if (rRow < table->rowHigh && (* table)[rRow + 1][rCol] <= element) {
-                rRow++;
-                run = !run;
-            } else if (rCol > 0) {
-                rCol--;
-                run = !run;
+        Trace::Scope _trace(Trace::VNT_FIND, size(), table->rowHigh + 1, table->colHigh + 1);
+        int _row = table->rowHigh;
+        int _col = 0;
+        while (_row >= 0 && _col <= table->colHigh) {
+            if (_col >= fill[_row]) {
+                _row--;
+                continue;
+            }
+            const T & _cell = cells(_row)[_col];
+            if (less(_cell, element)) _col++;
+            else if (less(element, _cell)) _row--;
+            else return true;
+        }
+        return false;
+    }
+
+    // number of elements less than or equal to "element" in time proportional to m + n
+    int countLessEqual(T element) {
+        return staircase(element, false);
+    }
+
+    // number of elements strictly less than "element" in time proportional to m + n
+    int rank(T element) {
+        return staircase(element, true);
+    }
+
+    // number of elements in ["low", "high"] in time proportional to m + n
+    int countInRange(T low, T high) {
+        if (less(high, low)) return 0;
+        return countLessEqual(high) - rank(low);
+    }
+
+    /*
+     * "k"th smallest element counting from 1
+     * integral types ordered by std::less binary search the value space over countLessEqual(), O((m + n) log(range))
+     * other types take the last element of topK(k), O(k log k)
+     */
+    T kthSmallest(int k) {
+        Trace::Scope _trace(Trace::VNT_SELECT, size(), k);
+        if (k < 1 || k > size()) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "select error: rank " << k << " out of range" << std::endl;
+            }
+            return _MAX;
+        }
+        if constexpr (valueSearch()) {
+            T _low = cells(0)[0];
+            T _high = largest();
+            while (_low < _high) {
+                T _middle = midpoint(_low, _high);
+                if (countLessEqual(_middle) >= k) _high = _middle;
+                else _low = _middle + 1;
+            }
+            return _low;
+        } else {
+            SafeArray<T> _top = topK(k);
+            return _top[k - 1];
+        }
+    }
+
+    /*
+     * batched queries over ascending "elements", every row is read once for the whole batch
+     * a pointer per row only moves right as the queries grow, so the cost is O(m(n + q)) for q queries
+     */
+    SafeArray<int> countLessEqual(const SafeArray<T> & elements) {
+        return staircase(elements, false);
+    }
+
+    SafeArray<int> rank(const SafeArray<T> & elements) {
+        return staircase(elements, true);
+    }
+
+    // "lows" and "highs" ascending and paired by index
+    SafeArray<int> countInRange(const SafeArray<T> & lows, const SafeArray<T> & highs) {
+        if (lows.getHigh() - lows.getLow() != highs.getHigh() - highs.getLow()) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "select error: range batch sizes " << lows.getHigh() - lows.getLow() + 1 << " "
+                          << highs.getHigh() - highs.getLow() + 1 << std::endl;
+            }
+            exit(1);
+        }
+        SafeArray<int> _result = countLessEqual(highs);
+        SafeArray<int> _below = rank(lows);
+        if (_result.getHigh() < 0) return _result;
+        int * _count = _result.data();
+        const int * _belowCount = _below.constData();
+        const T * _low = lows.constData();
+        const T * _high = highs.constData();
+        for (int index = 0; index <= _result.getHigh(); index++) {
+            _count[index] = less(_high[index], _low[index]) ? 0 : _count[index] - _belowCount[index];
+        }
+        return _result;
+    }
+
+    /*
+     * "k"th smallest for every rank in "ks" by binary searching all of them at once,
+     * each round sorts the midpoints and answers them with one batched count
+     */
+    SafeArray<T> kthSmallest(const SafeArray<int> & ks) {
+        int queries = ks.getHigh() - ks.getLow() + 1;
+        if (queries <= 0) return SafeArray<T>();
+        const int * _ks = ks.constData();
+        for (int index = 0; index < queries; index++) {
+            if (_ks[index] < 1 || _ks[index] > size()) {
+                if (SAFEARRAY_VNT_DEBUG) {
+                    std::cout << "select error: rank " << _ks[index] << " out of range" << std::endl;
+                }
+                exit(1);
+            }
+        }
+        std::vector<T> _answers(queries);
+        if constexpr (valueSearch()) {
+            std::vector<T> _low(queries, cells(0)[0]), _high(queries, largest());
+            while (true) {
+                std::vector<int> _open;
+                for (int index = 0; index < queries; index++) {
+                    if (_low[index] < _high[index]) _open.push_back(index);
+                }
+                if (_open.empty()) break;
+                std::vector<T> _middles(_open.size());
+                for (std::size_t index = 0; index < _open.size(); index++) {
+                    _middles[index] = midpoint(_low[_open[index]], _high[_open[index]]);
+                }
+                std::vector<std::size_t> _sorted(_open.size());
+                for (std::size_t index = 0; index < _sorted.size(); index++) {
+                    _sorted[index] = index;
+                }
+                std::sort(_sorted.begin(), _sorted.end(),
+                          [&](std::size_t a, std::size_t b) { return _middles[a] < _middles[b]; });
+                std::vector<T> _ascending(_open.size());
+                for (std::size_t index = 0; index < _sorted.size(); index++) {
+                    _ascending[index] = _middles[_sorted[index]];
+                }
+                std::vector<int> _counts = staircase(_ascending.data(), _ascending.size(), false);
+                for (std::size_t index = 0; index < _sorted.size(); index++) {
+                    int _query = _open[_sorted[index]];
+                    if (_counts[index] >= _ks[_query]) _high[_query] = _ascending[index];
+                    else _low[_query] = _ascending[index] + 1;
+                }
+            }
+            _answers = _low;
+        } else {
+            int _largest = * std::max_element(_ks, _ks + queries);
+            SafeArray<T> _top = topK(_largest);
+            for (int index = 0; index < queries; index++) {
+                _answers[index] = _top[_ks[index] - 1];
+            }
+        }
+        return toSafeArray(_answers);
+    }
+
+    // removes one occurrence of "element", found by the staircase walk and refilled in time proportional to m + n
+    bool remove(T element) {
+        Trace::Scope _trace(Trace::VNT_REMOVE, size(), table->rowHigh + 1, table->colHigh + 1);
+        int _row = table->rowHigh;
+        int _col = 0;
+        while (_row >= 0 && _col <= table->colHigh) {
+            if (_col >= fill[_row]) {
+                _row--;
+                continue;
+            }
+            const T & _cell = cells(_row)[_col];
+            if (less(_cell, element)) {
+                _col++;
+            } else if (less(element, _cell)) {
+                _row--;
+            } else {
+                sinkHole(_row, _col);
+                return true;
             }
         }
         return false;
     }
 
-    VNT<T> & operator=(const VNT<T> & l_t) {
+    // lowers the element at ("l_row", "l_col") to "element" and moves it up and left into place
+    void decreaseKey(int l_row, int l_col, T element) {
+        T & _cell = (* table)[l_row][l_col];
+        if (l_col >= fill[l_row] || less(_cell, element)) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "update error: decrease " << l_row << "," << l_col << " to " << element << std::endl;
+            }
+            exit(1);
+        }
+        // cells above and to the left of an occupied cell are always occupied
+        while (l_row > 0 || l_col > 0) {
+            T * _up = l_row > 0 ? row(l_row - 1) + l_col : nullptr;
+            T * _left = l_col > 0 ? row(l_row) + l_col - 1 : nullptr;
+            T * _larger = !_up ? _left : !_left ? _up : less(* _left, * _up) ? _up : _left;
+            if (!less(element, * _larger)) break;
+            row(l_row)[l_col] = * _larger;
+            if (_larger == _up) l_row--;
+            else l_col--;
+        }
+        row(l_row)[l_col] = element;
+    }
+
+    // raises the element at ("l_row", "l_col") to "element" and moves it down and right into place
+    void increaseKey(int l_row, int l_col, T element) {
+        T & _cell = (* table)[l_row][l_col];
+        if (l_col >= fill[l_row] || less(element, _cell) || (sentinel && !less(element, _MAX))) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "update error: increase " << l_row << "," << l_col << " to " << element << std::endl;
+            }
+            exit(1);
+        }
+        int rows = table->rowHigh + 1;
+        while (true) {
+            T * _right = l_col + 1 < fill[l_row] ? row(l_row) + l_col + 1 : nullptr;
+            T * _down = l_row + 1 < rows && l_col < fill[l_row + 1] ? row(l_row + 1) + l_col : nullptr;
+            T * _smaller = !_right ? _down : !_down ? _right : less(* _down, * _right) ? _down : _right;
+            if (!_smaller || !less(* _smaller, element)) break;
+            row(l_row)[l_col] = * _smaller;
+            if (_smaller == _right) l_col++;
+            else l_row++;
+        }
+        row(l_row)[l_col] = element;
+    }
+
+    /*
+     * adds every element of "l_VNT" to this table
+     * elements are added one by one when they fit, otherwise the table grows by whole rows
+     * and is rebuilt from both tables with build()
+     * false when a SENTINEL table cannot hold an element of "l_VNT", one at or above its _MAX,
+     * then neither table changes; a ROWFILL table holds every element
+     */
+    bool merge(VNT & l_VNT) {
+        Trace::Scope _trace(Trace::VNT_MERGE, size(), l_VNT.size());
+        if (sentinel && !l_VNT.isEmpty() && !less(l_VNT.largest(), _MAX)) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "merge error: value limit " << l_VNT.largest() << std::endl;
+            }
+            return false;
+        }
+        int cols = table->colHigh + 1;
+        int _total = size() + l_VNT.size();
+        std::vector<T> _elements;
+        l_VNT.collect(_elements);
+        if (_total <= capacity()) {
+            for (const T & element : _elements) {
+                add(element);
+            }
+            return true;
+        }
+        collect(_elements);
+        int _rows = (_total + cols - 1) / cols;
+        std::pmr::memory_resource * _resource = table->getResource();
+        delete table;
+        table = new SafeMatrix<T>(0, _rows - 1, 0, cols - 1, _resource);
+        build(_elements.data(), _elements.size());
+        return true;
+    }
+
+    // elements and row counts are copied into the resource of this table, the row counts keep their allocator
+    VNT & operator=(const VNT & l_t) {
         if (this == & l_t) return * this;
         _MAX = l_t._MAX;
+        compare = l_t.compare;
+        sentinel = l_t.sentinel;
+        fill = l_t.fill;
+        elements = l_t.elements;
+        std::pmr::memory_resource * _resource = table ? table->getResource() : nullptr;
         delete table;
-        table = new SafeMatrix<T>(* l_t.table);
+        if (!l_t.table) {
+            table = nullptr;
+        } else if (l_t.table->getResource() == _resource) {
+            // same resource, the rows stay shared until either table is written
+            table = new SafeMatrix<T>(* l_t.table);
+        } else {
+            int rows = l_t.table->rowHigh + 1;
+            int cols = l_t.table->colHigh + 1;
+            table = new SafeMatrix<T>(0, rows - 1, 0, cols - 1, _resource);
+            for (int _row = 0; _row < rows; _row++) {
+                std::copy(l_t.cells(_row), l_t.cells(_row) + cols, row(_row));
+            }
+        }
         return * this;
     }
 
-    friend std::ostream & operator<<(std::ostream & l_ostream, const VNT<T> & l_vnt) {
+    friend std::ostream & operator<<(std::ostream & l_ostream, const VNT & l_vnt) {
         for (int row = 0; row <= l_vnt.table->rowHigh; row++) {
             for (int col = 0; col <= l_vnt.table->colHigh; col++) {
-                if ((* l_vnt.table)[row][col] == l_vnt._MAX) l_ostream << "--\t";
-                else l_ostream << (* l_vnt.table)[row][col] << "\t";
+                if (col >= l_vnt.fill[row]) l_ostream << "--\t";
+                else l_ostream << l_vnt.cells(row)[col] << "\t";
             }
-            l_ostream << std::endl;
+            l_ostream << '\n';
         }
         return l_ostream;
     }
 
+private:
+    inline bool less(const T & a, const T & b) {
+        return compare(a, b);
+    }
+
+    static std::pmr::memory_resource * orDefault(std::pmr::memory_resource * l_resource) {
+        return l_resource ? l_resource : std::pmr::get_default_resource();
+    }
+
+    // numeric_limits max() or lowest(), whichever comes last in the order
+    static T largestValue() {
+        Compare _compare;
+        T _max = std::numeric_limits<T>::max();
+        T _lowest = std::numeric_limits<T>::lowest();
+        return _compare(_max, _lowest) ? _lowest : _max;
+    }
+
+    // value space binary search needs integer arithmetic that agrees with the order
+    static constexpr bool valueSearch() {
+        return std::is_integral<T>::value && std::is_same<Compare, std::less<T>>::value;
+    }
+
+    // storage of row "index" of the table, bounds are checked by the caller
+    T * row(int index) {
+        return table->rows()[index]->data();
+    }
+
+    // read only storage of row "index", rows shared with a copy of the table stay shared
+    const T * cells(int index) const {
+        return table->matrix[index]->constData();
+    }
+
+    // empty every cell of the table
+    void clear() {
+        fill.assign(table->rowHigh + 1, 0);
+        elements = 0;
+        if (sentinel)
+            table->fillMatrix(_MAX);
+    }
+
+    // largest element, the last occupied cell of some row
+    T largest() {
+        T _largest = cells(0)[fill[0] - 1];
+        for (int _row = 1; _row <= table->rowHigh && fill[_row] > 0; _row++) {
+            if (less(_largest, cells(_row)[fill[_row] - 1])) _largest = cells(_row)[fill[_row] - 1];
+        }
+        return _largest;
+    }
+
+    /*
+     * refill the hole at ("l_row", "l_col") by moving the smaller of its right and lower neighbours into it
+     * until neither is occupied, the cell left behind is the last one of its row and becomes empty
+     */
+    void sinkHole(int l_row, int l_col) {
+        int rows = table->rowHigh + 1;
+        while (true) {
+            T * _right = l_col + 1 < fill[l_row] ? row(l_row) + l_col + 1 : nullptr;
+            T * _down = l_row + 1 < rows && l_col < fill[l_row + 1] ? row(l_row + 1) + l_col : nullptr;
+            T * _smaller = !_right ? _down : !_down ? _right : less(* _right, * _down) ? _right : _down;
+            if (!_smaller) break;
+            row(l_row)[l_col] = * _smaller;
+            if (_smaller == _right) l_col++;
+            else l_row++;
+        }
+        fill[l_row]--;
+        elements--;
+        if (sentinel)
+            row(l_row)[l_col] = _MAX;
+    }
+
+    /*
+     * count elements at most (or below, if "l_strict") "l_element"
+     * starting at the bottom left, a cell in range counts its whole column above it and moves right,
+     * otherwise move up; empty cells are never counted
+     */
+    int staircase(const T & l_element, bool l_strict) {
+        int _count = 0;
+        int _row = table->rowHigh;
+        int _col = 0;
+        while (_row >= 0 && _col <= table->colHigh) {
+            if (_col < fill[_row] && (l_strict ? less(cells(_row)[_col], l_element)
+                                               : !less(l_element, cells(_row)[_col]))) {
+                _count += _row + 1;
+                _col++;
+            } else {
+                _row--;
+            }
+        }
+        return _count;
+    }
+
+    // batched staircase over "l_size" ascending "l_elements", one sequential pass per row
+    std::vector<int> staircase(const T * l_elements, std::size_t l_size, bool l_strict) {
+        for (std::size_t index = 1; index < l_size; index++) {
+            if (less(l_elements[index], l_elements[index - 1])) {
+                if (SAFEARRAY_VNT_DEBUG) {
+                    std::cout << "select error: batch not in ascending order" << std::endl;
+                }
+                exit(1);
+            }
+        }
+        std::vector<int> _counts(l_size, 0);
+        for (int _row = 0; _row <= table->rowHigh && fill[_row] > 0; _row++) {
+            const T * _cells = cells(_row);
+            int _fill = fill[_row];
+            int _col = 0;
+            for (std::size_t index = 0; index < l_size; index++) {
+                while (_col < _fill && (l_strict ? less(_cells[_col], l_elements[index])
+                                                 : !less(l_elements[index], _cells[_col]))) {
+                    _col++;
+                }
+                _counts[index] += _col;
+            }
+        }
+        return _counts;
+    }
+
+    SafeArray<int> staircase(const SafeArray<T> & l_elements, bool l_strict) {
+        if (l_elements.getHigh() < l_elements.getLow()) return SafeArray<int>();
+        std::vector<int> _counts = staircase(l_elements.constData(), l_elements.getHigh() - l_elements.getLow() + 1,
+                                             l_strict);
+        if (_counts.empty()) return SafeArray<int>();
+        SafeArray<int> _result(_counts.size() - 1);
+        std::copy(_counts.begin(), _counts.end(), _result.data());
+        return _result;
+    }
+
+    // midpoint of "l_low" <= "l_high" without signed overflow
+    static T midpoint(T l_low, T l_high) {
+        typedef typename std::make_unsigned<T>::type Unsigned;
+        return l_low + (T) (((Unsigned) l_high - (Unsigned) l_low) / 2);
+    }
+
+    static SafeArray<T> toSafeArray(const std::vector<T> & l_elements) {
+        if (l_elements.empty()) return SafeArray<T>();
+        SafeArray<T> _array(l_elements.size() - 1);
+        std::copy(l_elements.begin(), l_elements.end(), _array.data());
+        return _array;
+    }
+
+    // appends every element of the table to "l_elements"
+    void collect(std::vector<T> & l_elements) {
+        for (int _row = 0; _row <= table->rowHigh; _row++) {
+            l_elements.insert(l_elements.end(), cells(_row), cells(_row) + fill[_row]);
+        }
+    }
+
+    // row pointers into the storage of the table, bounds are checked once by the caller
+    void rowPointers(std::vector<T *> & l_rows) {
+        int rows = table->rowHigh - table->rowLow + 1;
+        l_rows.resize(rows);
+        for (int row = 0; row < rows; row++) {
+            l_rows[row] = table->rows()[row]->data();
+        }
+    }
+
+    /*
+     * fill the table with "array" in row major order, then restore the VNT order bottom up like heapify:
+     * cells are visited from bottom right to top left and each one sinks towards the bottom right
+     * by swapping with the smaller of its right and lower neighbours.
+     * Cells already visited always satisfy the VNT order among themselves, so the table is a VNT at the end.
+     * Every step is a single comparison on the raw storage, no add() and no bounds checks per element.
+     */
+    void build(const T array[], int size) {
+        int rows = table->rowHigh + 1;
+        int cols = table->colHigh + 1;
+        Trace::Scope _trace(Trace::VNT_BUILD, size, rows, cols);
+        if (size > rows * cols) {
+            if (SAFEARRAY_VNT_DEBUG) {
+                std::cout << "Constructor error: " << size << " elements exceed table size " << rows * cols << std::endl;
+            }
+            exit(1);
+        }
+        clear();
+        std::vector<T *> r;
+        rowPointers(r);
+        int _filled = 0;
+        for (int index = 0; index < size; index++) {
+            if (sentinel && less(_MAX, array[index])) {
+                if (SAFEARRAY_VNT_DEBUG) {
+                    std::cout << "insert error: value limit " << array[index] << std::endl;
+                }
+                continue;
+            }
+            // _MAX marks an empty cell
+            if (sentinel && !less(array[index], _MAX)) continue;
+            r[_filled / cols][_filled % cols] = array[index];
+            _filled++;
+        }
+        // row major filling leaves full rows above one partial row
+        for (int _row = 0; _row < rows; _row++) {
+            fill[_row] = std::max(0, std::min(cols, _filled - _row * cols));
+        }
+        elements = _filled;
+
+        for (int cell = _filled - 1; cell >= 0; cell--) {
+            int _row = cell / cols;
+            int _col = cell % cols;
+            T element = r[_row][_col];
+            while (true) {
+                T * _right = _col + 1 < fill[_row] ? r[_row] + _col + 1 : nullptr;
+                T * _down = _row + 1 < rows && _col < fill[_row + 1] ? r[_row + 1] + _col : nullptr;
+                T * _smaller = !_right ? _down : !_down ? _right : less(* _down, * _right) ? _down : _right;
+                if (!_smaller || !less(* _smaller, element)) break;
+                r[_row][_col] = * _smaller;
+                if (_smaller == _right) _col++;
+                else _row++;
+            }
+            r[_row][_col] = element;
+        }
+    }
 };
 
 #endif //SAFEARRAY_VNT_H
@@ -0,0 +1,74 @@
+/*
+ * Compares BatchMultiply against one SafeMatrix::operator* call per product
+ *
+ * Build: g++ -std=c++17 -O3 -march=native -pthread -I.. batch_multiply_bench.cpp
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+#define SAFEARRAY_SAFEARRAY_DEBUG false
+#define SAFEARRAY_SAFEMATRIX_DEBUG false
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "BatchMultiply.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double nanoseconds(Clock::time_point l_start, Clock::time_point l_end) {
+    return std::chrono::duration<double, std::nano>(l_end - l_start).count();
+}
+
+template <typename T>
+static void run(int n, long l_batch, const char * l_type) {
+    std::mt19937 _random(n);
+    std::uniform_real_distribution<double> _value(-1, 1);
+    long _elements = (long) n * n * l_batch;
+    std::vector<T> _a(_elements), _b(_elements), _c(_elements);
+    for (long i = 0; i < _elements; i++) {
+        _a[i] = (T) _value(_random);
+        _b[i] = (T) _value(_random);
+    }
+
+    // per call path, one heap result per product
+    SafeMatrix<T> a(n - 1), b(n - 1);
+    for (int row = 0; row < n; row++) {
+        for (int col = 0; col < n; col++) {
+            a[row][col] = _a[((long) row * n + col) * l_batch];
+            b[row][col] = _b[((long) row * n + col) * l_batch];
+        }
+    }
+    long _calls = std::min<long>(l_batch, 20000);
+    T _check = T();
+    Clock::time_point _start = Clock::now();
+    for (long call = 0; call < _calls; call++) {
+        SafeMatrix<T> & _result = a * b;
+        _check += _result[n - 1][n - 1];
+        delete & _result;
+    }
+    double _perCall = nanoseconds(_start, Clock::now()) / _calls;
+
+    // warm up, the first pass pays for page faults on the result
+    BatchMultiply<T>::multiply(_a.data(), _b.data(), _c.data(), n, n, n, l_batch, 1);
+    _start = Clock::now();
+    BatchMultiply<T>::multiply(_a.data(), _b.data(), _c.data(), n, n, n, l_batch, 1);
+    double _serial = nanoseconds(_start, Clock::now()) / l_batch;
+
+    _start = Clock::now();
+    BatchMultiply<T>::multiply(_a.data(), _b.data(), _c.data(), n, n, n, l_batch);
+    double _parallel = nanoseconds(_start, Clock::now()) / l_batch;
+
+    T _batched = _c[((long) (n - 1) * n + n - 1) * l_batch];
+    bool _match = std::abs((double) (_batched - _check / _calls)) < 1e-3;
+    std::printf("%-6s %2dx%-2d batch %-8ld per call %10.1f ns  batch 1 thread %8.2f ns  batch all threads %8.2f ns  %s\n",
+                l_type, n, n, l_batch, _perCall, _serial, _parallel, _match ? "ok" : "MISMATCH");
+}
+
+int main() {
+    for (int n : { 3, 4, 8, 16 }) {
+        run<float>(n, 1 << 18, "float");
+        run<double>(n, 1 << 18, "double");
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Throughput of ConcurrentVNT against thread count, half producers and half consumers
+ *
+ * Build: g++ -std=c++17 -O3 -march=native -pthread -I.. concurrent_vnt_bench.cpp
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+#define SAFEARRAY_SAFEARRAY_DEBUG false
+#define SAFEARRAY_SAFEMATRIX_DEBUG false
+#define SAFEARRAY_VNT_DEBUG false
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "ConcurrentVNT.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// operations per second for "l_threads" threads moving "l_elements" elements through the queue
+static double run(typename ConcurrentVNT<int>::Mode l_mode, int l_threads, long l_elements) {
+    int _producers = std::max(1, l_threads / 2);
+    int _consumers = std::max(1, l_threads - _producers);
+    ConcurrentVNT<int> _queue(2 * l_threads, 16, 16, 1 << 30, l_mode);
+    std::atomic<long> _popped(0);
+
+    Clock::time_point _start = Clock::now();
+    std::vector<std::thread> _workers;
+    for (int producer = 0; producer < _producers; producer++) {
+        _workers.emplace_back([&, producer]() {
+            unsigned _value = producer * 7919u;
+            for (long index = producer; index < l_elements; index += _producers) {
+                _value = _value * 1103515245u + 12345u;
+                while (!_queue.push(_value % 1000000)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (int consumer = 0; consumer < _consumers; consumer++) {
+        _workers.emplace_back([&]() {
+            int _element;
+            while (_popped.load(std::memory_order_relaxed) < l_elements) {
+                if (_queue.tryPop(_element)) _popped.fetch_add(1, std::memory_order_relaxed);
+                else std::this_thread::yield();
+            }
+        });
+    }
+    for (std::thread & worker : _workers) {
+        worker.join();
+    }
+    double _seconds = std::chrono::duration<double>(Clock::now() - _start).count();
+    // every element is pushed once and popped once
+    return 2.0 * l_elements / _seconds;
+}
+
+int main() {
+    long _elements = 400000;
+    for (int threads : { 1, 2, 4, 8 }) {
+        double _relaxed = run(ConcurrentVNT<int>::RELAXED, threads, _elements);
+        double _strict = run(ConcurrentVNT<int>::STRICT, threads, _elements);
+        std::printf("threads %2d  relaxed %8.2f Mops/s  strict %8.2f Mops/s\n", threads, _relaxed / 1e6, _strict / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Splits an OutOfCore multiply of MatrixFile operands into time spent on I/O and on compute,
+ * for several memory budgets, next to the in-memory product of the same operands
+ *
+ * Build: g++ -std=c++17 -O3 -march=native -pthread -I.. outofcore_bench.cpp
+ * Files are written to the working directory and removed.
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+#define SAFEARRAY_SAFEARRAY_DEBUG false
+#define SAFEARRAY_SAFEMATRIX_DEBUG false
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include "OutOfCore.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point l_start, Clock::time_point l_end) {
+    return std::chrono::duration<double, std::milli>(l_end - l_start).count();
+}
+
+static void run(int n, std::size_t l_budget, double l_inCore) {
+    OutOfCore<double>::Stats _stats;
+    if (!OutOfCore<double>::multiply("outofcore_bench_a.mat", "outofcore_bench_b.mat", "outofcore_bench_c.mat",
+                                     l_budget, & _stats)) {
+        std::printf("%4dx%-4d budget %8zu KiB  FAILED\n", n, n, l_budget / 1024);
+        return;
+    }
+    double _megabytes = (_stats.bytesRead + _stats.bytesWritten) / 1048576.0;
+    std::printf("%4dx%-4d budget %8zu KiB  tile %4d  I/O %8.1f MiB  read %8.2f ms  write %8.2f ms  "
+                "compute %8.2f ms  stall %8.2f ms  total %8.2f ms  in memory %8.2f ms\n",
+                n, n, l_budget / 1024, _stats.tileSize, _megabytes, _stats.readSeconds * 1e3,
+                _stats.writeSeconds * 1e3, _stats.computeSeconds * 1e3, _stats.stallSeconds * 1e3,
+                _stats.totalSeconds * 1e3, l_inCore);
+}
+
+int main() {
+    std::mt19937 _random(42);
+    std::uniform_real_distribution<double> _value(-1, 1);
+    for (int n : { 256, 512, 768 }) {
+        SafeMatrix<double> a(n - 1), b(n - 1);
+        for (int row = 0; row < n; row++) {
+            double * _a = a.rows()[row]->data();
+            double * _b = b.rows()[row]->data();
+            for (int col = 0; col < n; col++) {
+                _a[col] = _value(_random);
+                _b[col] = _value(_random);
+            }
+        }
+        MatrixFile<double>::write("outofcore_bench_a.mat", a);
+        MatrixFile<double>::write("outofcore_bench_b.mat", b);
+
+        Clock::time_point _start = Clock::now();
+        SafeMatrix<double> & _product = a * b;
+        double _inCore = milliseconds(_start, Clock::now());
+        delete & _product;
+
+        // budgets from a few small tiles up to one holding the whole operand
+        std::size_t _operand = (std::size_t) n * n * sizeof(double);
+        for (std::size_t budget : { _operand / 16, _operand / 2, 6 * _operand }) {
+            run(n, budget, _inCore);
+        }
+    }
+    std::remove("outofcore_bench_a.mat");
+    std::remove("outofcore_bench_b.mat");
+    std::remove("outofcore_bench_c.mat");
+    return 0;
+}
@@ -0,0 +1,621 @@
+/*
+ * Benchmark suite for the hot paths of Block, SafeArray, SafeMatrix and VNT, results printed as JSON
+ *
+ * Groups:
+ * allocator    Block allocate/free against malloc/free, ns per allocate and free pair
+ * elementwise  c = a + b through checked SafeMatrix indexing and through row pointers, GFLOP/s
+ * multiply     SafeMatrix operator* on small sizes and MatrixKernel::multiplyAdd on larger ones, GFLOP/s
+ * fixed        3x3 and 4x4 products through FixedMatrix against SafeMatrix operator*, ns per product
+ * vnt          add, find and extractMin, ns per operation
+ * construct    construction and copy of SafeArray, SafeMatrix and VNT, ns per object
+ * trace        cost of one Trace event, ns per event (whether or not SAFEARRAY_TRACE is on)
+ * structured   matrix-vector product of a dense matrix against StructuredMatrix storage, ns per product,
+ *              and the packed storage as a percentage of the dense one
+ * reduce       sum through a plain loop and through Reduce, max with index and inclusive scan, GB/s of input
+ * chain        n x 16 * 16 x n * n x 16 through MatrixChain in its planned order and left to right, ns per chain
+ * textio       SafeMatrix to CSV text through operator<< and TextIO::write, and TextIO::read back,
+ *              million elements per second
+ *
+ * Every case reports the fastest of several samples, each sample runs for at least --min-time milliseconds.
+ * Sizes stay within the static Block pool of each type, except structured, reduce, chain and textio which
+ * run last and let the pool of double grow.
+ *
+ * Build: cmake --build <build> --target safematrix_bench
+ * Usage: safematrix_bench [--min-time ms] [--out file.json]
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+#define SAFEARRAY_SAFEARRAY_DEBUG false
+#define SAFEARRAY_SAFEMATRIX_DEBUG false
+#define SAFEARRAY_VNT_DEBUG false
+#define SAFEARRAY_STRUCTUREDMATRIX_DEBUG false
+#define SAFEARRAY_REDUCE_DEBUG false
+#define SAFEARRAY_MATRIXCHAIN_DEBUG false
+#define SAFEARRAY_TEXTIO_DEBUG false
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "FixedMatrix.h"
+#include "MatrixChain.h"
+#include "MatrixKernel.h"
+#include "Reduce.h"
+#include "StructuredMatrix.h"
+#include "TextIO.h"
+#include "VNT.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// samples per case, the fastest one is reported
+static const int SAMPLES = 5;
+// live allocations kept by the allocator benchmark
+static const int SLOTS = 32;
+
+static double minTime = 20;
+
+// result accumulated by every benchmark so the compiler cannot drop the measured work
+static volatile double sink;
+
+struct Result {
+    std::string group;
+    std::string name;
+    std::string type;
+    std::string parameter;
+    double value;
+    std::string unit;
+};
+
+static std::vector<Result> results;
+
+template <typename T> struct TypeName;
+template <> struct TypeName<int> { static const char * name() { return "int"; } };
+template <> struct TypeName<float> { static const char * name() { return "float"; } };
+template <> struct TypeName<double> { static const char * name() { return "double"; } };
+
+/*
+ * seconds per call of "l_function(iterations)", the iteration count doubles until one sample
+ * takes at least minTime milliseconds, then the fastest of SAMPLES samples is kept
+ */
+template <typename Function>
+static double secondsPerIteration(Function l_function) {
+    long _iterations = 1;
+    while (true) {
+        Clock::time_point _start = Clock::now();
+        l_function(_iterations);
+        double _seconds = std::chrono::duration<double>(Clock::now() - _start).count();
+        if (_seconds * 1000 >= minTime) break;
+        _iterations *= 2;
+    }
+    double _best = 0;
+    for (int sample = 0; sample < SAMPLES; sample++) {
+        Clock::time_point _start = Clock::now();
+        l_function(_iterations);
+        double _seconds = std::chrono::duration<double>(Clock::now() - _start).count() / _iterations;
+        if (sample == 0 || _seconds < _best) _best = _seconds;
+    }
+    return _best;
+}
+
+static void report(const std::string & l_group, const std::string & l_name, const std::string & l_type,
+                   const std::string & l_parameter, double l_value, const std::string & l_unit) {
+    results.push_back({ l_group, l_name, l_type, l_parameter, l_value, l_unit });
+    std::fprintf(stderr, "%-12s %-18s %-7s %-10s %12.3f %s\n", l_group.c_str(), l_name.c_str(), l_type.c_str(),
+                 l_parameter.c_str(), l_value, l_unit.c_str());
+}
+
+static std::string square(int n) {
+    return std::to_string(n) + "x" + std::to_string(n);
+}
+
+/*
+ * allocator: a fixed random sequence of (slot, size) pairs, each step frees the slot and allocates again
+ * "small" 8-64 bytes, "medium" 64-512 bytes, "mixed" 8-512 bytes
+ */
+static void benchAllocator() {
+    struct Distribution {
+        const char * name;
+        int low, high;
+    };
+    const Distribution _distributions[] = { { "small", 8, 64 }, { "medium", 64, 512 }, { "mixed", 8, 512 } };
+    const int STEPS = 4096;
+    for (const Distribution & distribution : _distributions) {
+        std::mt19937 _generator(7);
+        std::vector<int> _slots(STEPS), _sizes(STEPS);
+        for (int step = 0; step < STEPS; step++) {
+            _slots[step] = _generator() % SLOTS;
+            _sizes[step] = distribution.low + _generator() % (distribution.high - distribution.low + 1);
+        }
+
+        // the pool is small and can fail under fragmentation, failed requests are counted instead of freed
+        long _failures = 0, _attempts = 0;
+        double _block = secondsPerIteration([&](long l_iterations) {
+            Block<unsigned char> * _live[SLOTS] = { };
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                int step = iteration % STEPS;
+                delete _live[_slots[step]];
+                _live[_slots[step]] = new (_sizes[step]) Block<unsigned char>;
+                _attempts++;
+                if (!_live[_slots[step]]) _failures++;
+                else _live[_slots[step]]->data[0] = (unsigned char) step;
+            }
+            for (Block<unsigned char> * block : _live) {
+                delete block;
+            }
+        });
+        double _malloc = secondsPerIteration([&](long l_iterations) {
+            void * _live[SLOTS] = { };
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                int step = iteration % STEPS;
+                std::free(_live[_slots[step]]);
+                _live[_slots[step]] = std::malloc(_sizes[step]);
+                * static_cast<unsigned char *>(_live[_slots[step]]) = (unsigned char) step;
+            }
+            for (void * block : _live) {
+                std::free(block);
+            }
+        });
+        report("allocator", "block", "bytes", distribution.name, _block * 1e9, "ns/op");
+        report("allocator", "malloc", "bytes", distribution.name, _malloc * 1e9, "ns/op");
+        report("allocator", "block_failure_rate", "bytes", distribution.name, 100.0 * _failures / _attempts, "%");
+    }
+}
+
+// element-wise addition over views of plain storage, the checked path goes through SafeMatrix and SafeArray
+template <typename T>
+static void benchElementwise() {
+    for (int n : { 64, 256, 1024 }) {
+        std::vector<T> _a(n * n, T(1)), _b(n * n, T(2)), _c(n * n);
+        SafeMatrix<T> a(_a.data(), 0, n - 1, 0, n - 1), b(_b.data(), 0, n - 1, 0, n - 1);
+        SafeMatrix<T> c(_c.data(), 0, n - 1, 0, n - 1);
+        double _checked = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                for (int row = 0; row < n; row++) {
+                    for (int col = 0; col < n; col++) {
+                        c[row][col] = a[row][col] + b[row][col];
+                    }
+                }
+            }
+            sink = sink + c[n - 1][n - 1];
+        });
+        double _unchecked = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                for (int row = 0; row < n; row++) {
+                    const T * _x = a.matrix[row]->constData();
+                    const T * _y = b.matrix[row]->constData();
+                    T * _z = c.rows()[row]->data();
+                    for (int col = 0; col < n; col++) {
+                        _z[col] = _x[col] + _y[col];
+                    }
+                }
+            }
+            sink = sink + _c[n * n - 1];
+        });
+        double _flops = (double) n * n;
+        report("elementwise", "add_checked", TypeName<T>::name(), square(n), _flops / _checked * 1e-9, "GFLOP/s");
+        report("elementwise", "add_rows", TypeName<T>::name(), square(n), _flops / _unchecked * 1e-9, "GFLOP/s");
+    }
+}
+
+// operator* allocates from the Block pool, so it runs on small sizes only, the kernel runs on views
+template <typename T>
+static void benchMultiply() {
+    for (int n : { 8, 16, 24 }) {
+        SafeMatrix<T> a(n - 1, n - 1), b(n - 1, n - 1);
+        a.fillMatrix(T(1));
+        b.fillMatrix(T(2));
+        double _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                SafeMatrix<T> & c = a * b;
+                sink = sink + c[0][0];
+                delete & c;
+            }
+        });
+        report("multiply", "operator*", TypeName<T>::name(), square(n), 2.0 * n * n * n / _seconds * 1e-9, "GFLOP/s");
+    }
+    for (int n : { 64, 128, 256, 512 }) {
+        std::vector<T> _a(n * n, T(1)), _b(n * n, T(2)), _c(n * n);
+        std::vector<T *> a(n), b(n), c(n);
+        for (int row = 0; row < n; row++) {
+            a[row] = _a.data() + row * n;
+            b[row] = _b.data() + row * n;
+            c[row] = _c.data() + row * n;
+        }
+        double _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                MatrixKernel<T>::clear(c.data(), n, n);
+                MatrixKernel<T>::multiplyAdd(c.data(), a.data(), b.data(), n, n, n);
+            }
+            sink = sink + _c[0];
+        });
+        report("multiply", "kernel", TypeName<T>::name(), square(n), 2.0 * n * n * n / _seconds * 1e-9, "GFLOP/s");
+    }
+}
+
+// a chain of products so every one depends on the last, FixedMatrix keeps the operands in registers or on the stack
+template <typename T, int N>
+static void benchFixed() {
+    FixedMatrix<T, 0, N - 1, 0, N - 1> a, b;
+    SafeMatrix<T> _a(N - 1, N - 1), _b(N - 1, N - 1);
+    for (int row = 0; row < N; row++) {
+        for (int col = 0; col < N; col++) {
+            // close to the identity, so repeated products stay finite
+            a[row][col] = _a[row][col] = (row == col ? T(1) : T(0));
+            b[row][col] = _b[row][col] = (row == col ? T(1) : T(0));
+        }
+    }
+    double _fixed = secondsPerIteration([&](long l_iterations) {
+        FixedMatrix<T, 0, N - 1, 0, N - 1> c = a;
+        for (long iteration = 0; iteration < l_iterations; iteration++) {
+            c = c * b;
+        }
+        sink = sink + c.data[N - 1][N - 1];
+    });
+    report("fixed", "FixedMatrix", TypeName<T>::name(), square(N), _fixed * 1e9, "ns/op");
+    double _safe = secondsPerIteration([&](long l_iterations) {
+        SafeMatrix<T> c = _a;
+        for (long iteration = 0; iteration < l_iterations; iteration++) {
+            SafeMatrix<T> & _next = c * _b;
+            c = _next;
+            delete & _next;
+        }
+        sink = sink + c.matrix[N - 1]->constData()[N - 1];
+    });
+    report("fixed", "operator*", TypeName<T>::name(), square(N), _safe * 1e9, "ns/op");
+}
+
+// fill an empty table, look up present and absent values, then drain it
+static void benchVNT() {
+    const int MAX = 1 << 30;
+    for (int n : { 8, 16, 32 }) {
+        int _size = n * n;
+        std::mt19937 _generator(11);
+        std::vector<int> _input(_size), _queries(_size);
+        for (int index = 0; index < _size; index++) {
+            _input[index] = _generator() % (4 * _size);
+            _queries[index] = _generator() % (4 * _size);
+        }
+        VNT<int> _table(n, n, MAX);
+        double _add = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                VNT<int> _empty(n, n, MAX);
+                for (int element : _input) {
+                    _empty.add(element);
+                }
+                sink = sink + _empty.getMin();
+            }
+        });
+        for (int element : _input) {
+            _table.add(element);
+        }
+        double _find = secondsPerIteration([&](long l_iterations) {
+            long _found = 0;
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                for (int query : _queries) {
+                    _found += _table.find(query);
+                }
+            }
+            sink = sink + _found;
+        });
+        double _extract = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                VNT<int> _full(n, n, MAX, _input.data(), _size);
+                while (!_full.isEmpty()) {
+                    sink = sink + _full.extractMin();
+                }
+            }
+        });
+        // bulk construction is subtracted from the extract samples so only extractMin is counted
+        double _build = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                VNT<int> _full(n, n, MAX, _input.data(), _size);
+                sink = sink + _full.getMin();
+            }
+        });
+        report("vnt", "add", "int", square(n), _add / _size * 1e9, "ns/op");
+        report("vnt", "find", "int", square(n), _find / _size * 1e9, "ns/op");
+        report("vnt", "extractMin", "int", square(n), std::max(0.0, _extract - _build) / _size * 1e9, "ns/op");
+        report("vnt", "build", "int", square(n), _build / _size * 1e9, "ns/op");
+    }
+}
+
+template <typename T>
+static void benchConstruct() {
+    for (int n : { 8, 32, 64 }) {
+        SafeArray<T> _source(n - 1);
+        double _construct = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                SafeArray<T> _array(n - 1);
+                sink = sink + _array.constData()[0];
+            }
+        });
+        double _copy = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                // read only, a write would time the copy made on write as well
+                SafeArray<T> _array(_source);
+                sink = sink + _array.constData()[0];
+            }
+        });
+        report("construct", "SafeArray", TypeName<T>::name(), std::to_string(n), _construct * 1e9, "ns/op");
+        report("construct", "SafeArray_copy", TypeName<T>::name(), std::to_string(n), _copy * 1e9, "ns/op");
+    }
+    for (int n : { 8, 16 }) {
+        SafeMatrix<T> _source(n - 1, n - 1);
+        double _construct = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                SafeMatrix<T> _matrix(n - 1, n - 1);
+                sink = sink + _matrix.matrix[0]->constData()[0];
+            }
+        });
+        double _copy = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                SafeMatrix<T> _matrix(_source);
+                sink = sink + _matrix.matrix[0]->constData()[0];
+            }
+        });
+        report("construct", "SafeMatrix", TypeName<T>::name(), square(n), _construct * 1e9, "ns/op");
+        report("construct", "SafeMatrix_copy", TypeName<T>::name(), square(n), _copy * 1e9, "ns/op");
+    }
+}
+
+static void benchConstructVNT() {
+    for (int n : { 8, 16 }) {
+        VNT<int> _source(n, n, 1 << 30);
+        for (int element = 0; element < n * n; element++) {
+            _source.add(element);
+        }
+        double _copy = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                VNT<int> _table(_source);
+                sink = sink + _table.getMin();
+            }
+        });
+        report("construct", "VNT_copy", "int", square(n), _copy * 1e9, "ns/op");
+    }
+}
+
+// events are recorded directly, the hooks in the library only call Trace when SAFEARRAY_TRACE is true
+static void benchTrace() {
+    double _instant = secondsPerIteration([&](long l_iterations) {
+        for (long iteration = 0; iteration < l_iterations; iteration++) {
+            Trace::instant(Trace::ALLOCATE, iteration, 64);
+        }
+    });
+    double _scope = secondsPerIteration([&](long l_iterations) {
+        for (long iteration = 0; iteration < l_iterations; iteration++) {
+            Trace::record(Trace::VNT_FIND, 'B', iteration, 8, 8);
+            Trace::record(Trace::VNT_FIND, 'E', 0, 0, 0);
+        }
+    });
+    Trace::clear();
+    report("trace", "instant", "event", "1", _instant * 1e9, "ns/op");
+    report("trace", "scope", "event", "2", _scope * 1e9, "ns/op");
+}
+
+// y = a * x for a dense row major "a" against symmetric, lower triangular and 5 diagonal band storage
+static void benchStructured() {
+    typedef StructuredMatrix<double> Matrix;
+    for (int n : { 64, 256 }) {
+        std::vector<double> _dense(n * n, 1.0), _x(n, 1.0), _y(n);
+        double _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                for (int row = 0; row < n; row++) {
+                    const double * _a = _dense.data() + row * n;
+                    double _sum = 0;
+                    for (int col = 0; col < n; col++) {
+                        _sum += _a[col] * _x[col];
+                    }
+                    _y[row] = _sum;
+                }
+                sink = sink + _y[0];
+            }
+        });
+        report("structured", "matvec_dense", "double", square(n), _seconds * 1e9, "ns/op");
+
+        SafeArray<double> x(0, n - 1);
+        x.fillArray(1.0);
+        Matrix _symmetric(n - 1, Matrix::SYMMETRIC), _lower(n - 1, Matrix::LOWER), _band(0, n - 1, 2, 2);
+        const std::pair<const char *, Matrix *> _cases[] = {
+                { "symmetric", & _symmetric }, { "lower", & _lower }, { "band5", & _band } };
+        for (const std::pair<const char *, Matrix *> & _case : _cases) {
+            _case.second->fillMatrix(1.0);
+            _seconds = secondsPerIteration([&](long l_iterations) {
+                for (long iteration = 0; iteration < l_iterations; iteration++) {
+                    SafeArray<double> y = * _case.second * x;
+                    sink = sink + y[0];
+                }
+            });
+            report("structured", std::string("matvec_") + _case.first, "double", square(n), _seconds * 1e9, "ns/op");
+            report("structured", std::string("storage_") + _case.first, "double", square(n),
+                   100.0 * _case.second->storage() / ((double) n * n), "%");
+        }
+    }
+}
+
+// sum, max and scan of a double array in and out of cache, all threads
+static void benchReduce() {
+    for (int n : { 4096, 1 << 20 }) {
+        SafeArray<double> a(0, n - 1), _scan(0, n - 1);
+        for (int i = 0; i < n; i++) {
+            a[i] = (i % 17) * 0.5;
+        }
+        double _bytes = (double) n * sizeof(double);
+        const double * _a = a.constData();
+        double _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                double _sum = 0;
+                for (int i = 0; i < n; i++) {
+                    _sum += _a[i];
+                }
+                sink = sink + _sum;
+            }
+        });
+        report("reduce", "sum_loop", "double", std::to_string(n), _bytes / _seconds * 1e-9, "GB/s");
+        _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                sink = sink + Reduce<double>::sum(a);
+            }
+        });
+        report("reduce", "sum", "double", std::to_string(n), _bytes / _seconds * 1e-9, "GB/s");
+        _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                sink = sink + Reduce<double>::max(a).index;
+            }
+        });
+        report("reduce", "max", "double", std::to_string(n), _bytes / _seconds * 1e-9, "GB/s");
+        _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                Reduce<double>::inclusiveScan(a, _scan);
+                sink = sink + _scan[n - 1];
+            }
+        });
+        report("reduce", "inclusive_scan", "double", std::to_string(n), _bytes / _seconds * 1e-9, "GB/s");
+    }
+}
+
+/*
+ * chain: the same tall and skinny chain in the order MatrixChain plans, (A0 (A1 A2)),
+ * and left to right, ((A0 A1) A2), as two MatrixChain products of two operands through an n x n intermediate
+ */
+static void benchChain() {
+    for (int n : { 128, 512 }) {
+        SafeMatrix<double> a(n - 1, 15), b(15, n - 1), c(n - 1, 15), _result(n - 1, 15), _intermediate(n - 1, n - 1);
+        a.fillMatrix(1.0);
+        b.fillMatrix(2.0);
+        c.fillMatrix(0.5);
+        SafeMatrix<double> * _chain[] = { & a, & b, & c };
+        MatrixChain<double> _multiplier;
+        double _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                _multiplier.multiply(_chain, 3, _result);
+            }
+            sink = sink + _result.matrix[0]->constData()[0];
+        });
+        std::string _shape = std::to_string(n) + "x16";
+        report("chain", "planned", "double", _shape, _seconds * 1e9, "ns/op");
+        _seconds = secondsPerIteration([&](long l_iterations) {
+            for (long iteration = 0; iteration < l_iterations; iteration++) {
+                _multiplier.multiply(_chain, 2, _intermediate);
+                _multiplier.multiply({ & _intermediate, & c }, _result);
+            }
+            sink = sink + _result.matrix[0]->constData()[0];
+        });
+        report("chain", "left_to_right", "double", _shape, _seconds * 1e9, "ns/op");
+    }
+}
+
+// a 1000 x 1000 double matrix as CSV, the file is written to the working directory and removed afterwards
+static void benchTextIO() {
+    const int n = 1000;
+    const char * _path = "safematrix_bench_textio.csv";
+    SafeMatrix<double> a(0, n - 1, 0, n - 1), b;
+    std::mt19937 _random(7);
+    std::uniform_real_distribution<double> _value(-1000, 1000);
+    for (int row = 0; row < n; row++) {
+        double * _row = a.rows()[row]->data();
+        for (int col = 0; col < n; col++) {
+            _row[col] = _value(_random);
+        }
+    }
+    double _elements = (double) n * n * 1e-6;
+    double _seconds = secondsPerIteration([&](long l_iterations) {
+        for (long iteration = 0; iteration < l_iterations; iteration++) {
+            std::ostringstream _out;
+            _out << a;
+            sink = sink + _out.tellp();
+        }
+    });
+    report("textio", "write_ostream", "double", square(n), _elements / _seconds, "Melem/s");
+    _seconds = secondsPerIteration([&](long l_iterations) {
+        for (long iteration = 0; iteration < l_iterations; iteration++) {
+            std::ostringstream _out;
+            TextIO<double>::write(_out, a);
+            sink = sink + _out.tellp();
+        }
+    });
+    report("textio", "write", "double", square(n), _elements / _seconds, "Melem/s");
+    if (!TextIO<double>::write(_path, a)) return;
+    _seconds = secondsPerIteration([&](long l_iterations) {
+        for (long iteration = 0; iteration < l_iterations; iteration++) {
+            TextIO<double>::read(_path, b);
+            sink = sink + b[0][0];
+        }
+    });
+    report("textio", "read", "double", square(n), _elements / _seconds, "Melem/s");
+    std::remove(_path);
+}
+
+// JSON string escaping for the few characters that can appear in names
+static std::string quote(const std::string & l_text) {
+    std::string _quoted = "\"";
+    for (char character : l_text) {
+        if (character == '"' || character == '\\') _quoted += '\\';
+        _quoted += character;
+    }
+    return _quoted + "\"";
+}
+
+static void writeJSON(FILE * l_file) {
+    std::fprintf(l_file, "{\n  \"suite\": \"safematrix_bench\",\n  \"min_time_ms\": %g,\n  \"samples\": %d,\n",
+                 minTime, SAMPLES);
+    std::fprintf(l_file, "  \"results\": [\n");
+    for (std::size_t index = 0; index < results.size(); index++) {
+        const Result & result = results[index];
+        std::fprintf(l_file, "    {\"group\": %s, \"name\": %s, \"type\": %s, \"parameter\": %s, "
+                             "\"value\": %.6g, \"unit\": %s}%s\n",
+                     quote(result.group).c_str(), quote(result.name).c_str(), quote(result.type).c_str(),
+                     quote(result.parameter).c_str(), result.value, quote(result.unit).c_str(),
+                     index + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(l_file, "  ]\n}\n");
+}
+
+int main(int argc, char * argv[]) {
+    const char * _output = nullptr;
+    for (int index = 1; index < argc; index++) {
+        if (!std::strcmp(argv[index], "--min-time") && index + 1 < argc) {
+            minTime = std::atof(argv[++index]);
+        } else if (!std::strcmp(argv[index], "--out") && index + 1 < argc) {
+            _output = argv[++index];
+        } else {
+            std::fprintf(stderr, "usage: %s [--min-time ms] [--out file.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    benchAllocator();
+    benchElementwise<float>();
+    benchElementwise<double>();
+    benchElementwise<int>();
+    benchMultiply<float>();
+    benchMultiply<double>();
+    benchMultiply<int>();
+    benchFixed<float, 3>();
+    benchFixed<float, 4>();
+    benchFixed<double, 3>();
+    benchFixed<double, 4>();
+    benchVNT();
+    benchConstruct<float>();
+    benchConstruct<double>();
+    benchConstruct<int>();
+    benchConstructVNT();
+    benchTrace();
+    benchStructured();
+    benchReduce();
+    benchChain();
+    benchTextIO();
+
+    FILE * _file = _output ? std::fopen(_output, "w") : stdout;
+    if (!_file) {
+        std::fprintf(stderr, "cannot open %s\n", _output);
+        return 1;
+    }
+    writeJSON(_file);
+    if (_output) std::fclose(_file);
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Compares VNT as a priority queue against std::priority_queue on the same workloads
+ *
+ * Build: g++ -std=c++17 -O3 -march=native -I.. vnt_queue_bench.cpp
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+#define SAFEARRAY_SAFEARRAY_DEBUG false
+#define SAFEARRAY_SAFEMATRIX_DEBUG false
+#define SAFEARRAY_VNT_DEBUG false
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include <random>
+#include <vector>
+#include "VNT.h"
+
+typedef std::chrono::steady_clock Clock;
+typedef std::priority_queue<int, std::vector<int>, std::greater<int>> MinQueue;
+
+static const int MAX = 1 << 30;
+
+static double nanoseconds(Clock::time_point l_start, Clock::time_point l_end) {
+    return std::chrono::duration<double, std::nano>(l_end - l_start).count();
+}
+
+static void report(const char * l_workload, int n, double l_vnt, double l_queue) {
+    std::printf("%-22s %3dx%-3d  VNT %9.1f ns/op  priority_queue %9.1f ns/op\n", l_workload, n, n, l_vnt, l_queue);
+}
+
+int main() {
+    std::mt19937 _random(42);
+    for (int n : { 8, 16, 32, 64 }) {
+        int _size = n * n;
+        std::vector<int> _input(_size);
+        for (int & element : _input) {
+            element = _random() % 1000000;
+        }
+        int _rounds = 200000 / _size + 1;
+        long _check = 0;
+
+        // build from a batch, then drain everything in order
+        Clock::time_point _start = Clock::now();
+        for (int round = 0; round < _rounds; round++) {
+            VNT<int> _table(n, n, MAX, _input.data(), _size);
+            for (int element : _table.drain()) {
+                _check += element;
+            }
+        }
+        double _vnt = nanoseconds(_start, Clock::now()) / ((double) _rounds * _size);
+        _start = Clock::now();
+        for (int round = 0; round < _rounds; round++) {
+            MinQueue _queue(std::greater<int>(), _input);
+            while (!_queue.empty()) {
+                _check -= _queue.top();
+                _queue.pop();
+            }
+        }
+        double _queueTime = nanoseconds(_start, Clock::now()) / ((double) _rounds * _size);
+        report("build + drain", n, _vnt, _queueTime);
+
+        // half full queue, each operation extracts the minimum and inserts a new element
+        long _operations = 200000;
+        VNT<int> _table(n, n, MAX, _input.data(), _size / 2);
+        MinQueue _queue(std::greater<int>(), std::vector<int>(_input.begin(), _input.begin() + _size / 2));
+        _start = Clock::now();
+        for (long operation = 0; operation < _operations; operation++) {
+            _check += _table.extractMin();
+            _table.add(_input[operation % _size]);
+        }
+        _vnt = nanoseconds(_start, Clock::now()) / _operations;
+        _start = Clock::now();
+        for (long operation = 0; operation < _operations; operation++) {
+            _check -= _queue.top();
+            _queue.pop();
+            _queue.push(_input[operation % _size]);
+        }
+        _queueTime = nanoseconds(_start, Clock::now()) / _operations;
+        report("extractMin + add", n, _vnt, _queueTime);
+
+        // 16 smallest without removing them, the queue has to be copied
+        _start = Clock::now();
+        for (long operation = 0; operation < _operations / 10; operation++) {
+            SafeArray<int> _top = _table.topK(16);
+            _check += _top[0];
+        }
+        _vnt = nanoseconds(_start, Clock::now()) / (_operations / 10);
+        _start = Clock::now();
+        for (long operation = 0; operation < _operations / 10; operation++) {
+            MinQueue _copy(_queue);
+            _check -= _copy.top();
+            for (int k = 0; k < 16; k++) {
+                _copy.pop();
+            }
+        }
+        _queueTime = nanoseconds(_start, Clock::now()) / (_operations / 10);
+        report("topK(16)", n, _vnt, _queueTime);
+
+        if (_check != 0) std::printf("checksum mismatch %ld\n", _check);
+    }
+    return 0;
+}
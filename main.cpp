@@ -39,41 +39,6 @@
 #include "VNT.h"
 using namespace std;
 
-template <typename T>
-size_t Block<T>::requestSize = 0;
-template <typename T>
-size_t Block<T>::blockSize = 0;
-template <typename T>
-int Block<T>::blockCnt = 0;
-template <typename T>
-int Block<T>::searchCnt = 0;
-template <typename T>
-int Block<T>::requestCnt = 0;
-template <typename T>
-int Block<T>::failureCnt = 0;
-template <typename T>
-int Block<T>::splitCnt = 0;
-template <typename T>
-int Block<T>::coalesceCnt = 0;
-template <typename T>
-double Block<T>::avgSearchCnt = 0;
-template <typename T>
-double Block<T>::successRate = 0;
-template <typename T>
-double Block<T>::failureRate = 0;
-
-template <typename T>
-typename Block<T>::Header * Block<T>::MEMPOOL;
-template <typename T>
-uintptr_t * Block<T>::LMEMPOOLBOUND;
-template <typename T>
-uintptr_t * Block<T>::RMEMPOOLBOUND;
-template <typename T>
-typename Block<T>::Header * Block<T>::AV;
-
-template <typename T>
-int Block<T>::MINDATASIZE = 32; // must be greater than 6
-
 int main() {
 
     /*
@@ -0,0 +1,35 @@
+/*
+ * Check.h holds the assertion of the unit tests, unlike assert() it stays active in Release builds
+ *
+ * CHECK() reports the failed condition with its line and counts it, a test returns report() from main
+ * so ctest sees a non zero exit code when any check failed.
+ */
+
+#ifndef SAFEARRAY_CHECK_H
+#define SAFEARRAY_CHECK_H
+
+#include <cmath>
+#include <iostream>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cout << __FILE__ << ":" << __LINE__ << " check failed: " #condition << std::endl; \
+            failures++; \
+        } \
+    } while (0)
+
+// "a" and "b" agree to "tolerance" relative to the larger of them, or absolutely near 0
+inline bool near(double a, double b, double tolerance = 1e-9) {
+    return std::fabs(a - b) <= tolerance * std::fmax(1.0, std::fmax(std::fabs(a), std::fabs(b)));
+}
+
+inline int report(const char * l_test) {
+    if (failures) std::cout << l_test << ": " << failures << " checks failed" << std::endl;
+    else std::cout << l_test << ": passed" << std::endl;
+    return failures ? 1 : 0;
+}
+
+#endif //SAFEARRAY_CHECK_H
@@ -0,0 +1,125 @@
+/*
+ * Block pool arenas: growth up to maxArenas, failure past it, reuse after release and dedicated arenas
+ * for requests larger than a block, which maxArenas does not limit.
+ * Each test uses a pool type of its own so the pools start empty.
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+
+#include <vector>
+#include "SafeMatrix.h"
+#include "Check.h"
+
+enum { DATASIZE = 64, BLOCKS = 4 };
+
+// bytes filling one block of a DATASIZE arena exactly, so no block is split
+static const std::size_t WHOLEBLOCK = DATASIZE * sizeof(uintptr_t);
+
+static BlockConfig geometry(int l_maxArenas) {
+    BlockConfig _config;
+    _config.dataSize = DATASIZE;
+    _config.blockCount = BLOCKS;
+    _config.maxArenas = l_maxArenas;
+    return _config;
+}
+
+static void growsUpToMaxArenas() {
+    Block<long>::configure(geometry(2));
+    std::vector<Block<long> *> _blocks;
+    for (int i = 0; i < 2 * BLOCKS; i++) {
+        _blocks.push_back(new (WHOLEBLOCK) Block<long>);
+        CHECK(_blocks.back() != nullptr);
+    }
+    CHECK(Block<long>::arenaCnt == 2);
+
+    // blocks of both arenas are disjoint
+    for (int i = 0; i < (int) _blocks.size(); i++) {
+        for (int j = 0; j < DATASIZE; j++) (* _blocks[i])[j] = i;
+    }
+    bool _intact = true;
+    for (int i = 0; i < (int) _blocks.size(); i++) {
+        for (int j = 0; j < DATASIZE; j++) _intact = _intact && (* _blocks[i])[j] == i;
+    }
+    CHECK(_intact);
+
+    int _failures = Block<long>::failureCnt;
+    CHECK(new (WHOLEBLOCK) Block<long> == nullptr);
+    CHECK(Block<long>::failureCnt == _failures + 1);
+    CHECK(Block<long>::arenaCnt == 2);
+
+    // released blocks are found again without another arena
+    for (Block<long> * block : _blocks) delete block;
+    for (Block<long> *& block : _blocks) {
+        block = new (WHOLEBLOCK) Block<long>;
+        CHECK(block != nullptr);
+    }
+    CHECK(Block<long>::arenaCnt == 2);
+    for (Block<long> * block : _blocks) delete block;
+}
+
+static void coalescesReleasedBlocks() {
+    Block<short>::configure(geometry(1));
+    std::vector<Block<short> *> _blocks;
+    for (int i = 0; i < BLOCKS; i++) _blocks.push_back(new (WHOLEBLOCK) Block<short>);
+    for (Block<short> * block : _blocks) delete block;
+    CHECK(Block<short>::coalesceCnt > 0);
+
+    // two neighbours merged back into one free block can hold a request larger than a block
+    Block<short> * _large = new (2 * WHOLEBLOCK) Block<short>;
+    CHECK(_large != nullptr);
+    CHECK(Block<short>::arenaCnt == 1);
+    delete _large;
+}
+
+static void largeRequestsGetDedicatedArenas() {
+    // dedicated arenas do not count against maxArenas
+    Block<double>::configure(geometry(1));
+    Block<double> * _small = new (WHOLEBLOCK) Block<double>;
+    int _arenas = Block<double>::arenaCnt;
+    const int _elements = 1000;
+    Block<double> * _large = new (_elements * sizeof(double)) Block<double>;
+    CHECK(_large != nullptr);
+    CHECK(Block<double>::arenaCnt == _arenas + 1 && Block<double>::dedicatedCnt == 1);
+    for (int i = 0; i < _elements; i++) (* _large)[i] = i;
+    double _sum = 0;
+    for (int i = 0; i < _elements; i++) _sum += (* _large)[i];
+    CHECK(_sum == _elements * (_elements - 1) / 2.0);
+    delete _large;
+
+    // a second request of the same size reuses the dedicated arena
+    _large = new (_elements * sizeof(double)) Block<double>;
+    CHECK(_large != nullptr);
+    CHECK(Block<double>::arenaCnt == _arenas + 1);
+    delete _large;
+    delete _small;
+}
+
+static void wideRowsWorkWithDefaultGeometry() {
+    // no configure() call, the pool has a single regular arena
+    SafeMatrix<float> a(0, 99, 0, 149);
+    a[0][0] = 1;
+    a[99][149] = 2;
+    const SafeMatrix<float> & _a = a;
+    CHECK(_a[0][0] == 1 && _a[99][149] == 2 && _a[50][75] == 0);
+    CHECK(Block<float>::dedicatedCnt > 0);
+    CHECK(Block<float>::arenaCnt - Block<float>::dedicatedCnt == 1);
+}
+
+static void configurationIsKept() {
+    BlockConfig _config = geometry(3);
+    _config.minDataSize = 8;
+    Block<char>::configure(_config);
+    CHECK(Block<char>::configuration().dataSize == DATASIZE);
+    CHECK(Block<char>::configuration().blockCount == BLOCKS);
+    CHECK(Block<char>::configuration().maxArenas == 3);
+    CHECK(Block<char>::configuration().minDataSize == 8);
+}
+
+int main() {
+    growsUpToMaxArenas();
+    coalescesReleasedBlocks();
+    largeRequestsGetDedicatedArenas();
+    wideRowsWorkWithDefaultGeometry();
+    configurationIsKept();
+    return report("block_test");
+}
@@ -0,0 +1,275 @@
+/*
+ * MatrixFile and TextIO round trips: every element read back equals the one written, bounds are kept,
+ * and damaged or malformed files are refused. OutOfCore products of files match the in-memory product.
+ * Files are written to the working directory and removed.
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+#define SAFEARRAY_MATRIXFILE_DEBUG false
+#define SAFEARRAY_TEXTIO_DEBUG false
+#define SAFEARRAY_OUTOFCORE_DEBUG false
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include "MatrixFile.h"
+#include "OutOfCore.h"
+#include "TextIO.h"
+#include "Check.h"
+
+template <typename T>
+static bool equal(const SafeMatrix<T> & a, const SafeMatrix<T> & b) {
+    if (a.rowLow != b.rowLow || a.rowHigh != b.rowHigh || a.colLow != b.colLow || a.colHigh != b.colHigh)
+        return false;
+    int cols = a.colHigh - a.colLow + 1;
+    for (int row = 0; row <= a.rowHigh - a.rowLow; row++) {
+        if (!std::equal(a.matrix[row]->constData(), a.matrix[row]->constData() + cols, b.matrix[row]->constData()))
+            return false;
+    }
+    return true;
+}
+
+static SafeMatrix<double> sample() {
+    SafeMatrix<double> _matrix(-1, 2, 1, 3);
+    double _values[] = { 0.1, 1.0 / 3, -2.5, 1e-300, 6.02214076e23, -0.0, 42, std::numeric_limits<double>::max(),
+                         std::numeric_limits<double>::denorm_min(), -1e-7, 7, 0 };
+    int _next = 0;
+    for (int row = -1; row <= 2; row++) {
+        for (int col = 1; col <= 3; col++) _matrix[row][col] = _values[_next++];
+    }
+    return _matrix;
+}
+
+static void writeText(const char * l_path, const char * l_text) {
+    std::ofstream _out(l_path, std::ios::binary | std::ios::trunc);
+    _out << l_text;
+}
+
+static void mapsWrittenMatrix() {
+    const char * _path = "file_test.mat";
+    SafeMatrix<double> _matrix = sample();
+    CHECK(MatrixFile<double>::write(_path, _matrix));
+
+    MatrixFile<double>::Layout _layout;
+    CHECK(MatrixFile<double>::layout(_path, _layout));
+    CHECK(_layout.rowLow == -1 && _layout.rowHigh == 2 && _layout.colLow == 1 && _layout.colHigh == 3);
+    CHECK(_layout.dataOffset % 4096 == 0);
+    {
+        MatrixFile<double> _file(_path, MatrixFile<double>::READONLY, true);
+        CHECK(_file.isOpen());
+        CHECK(equal(_file.matrix(), _matrix));
+    }
+    {
+        // private pages take the write, the file keeps its contents
+        MatrixFile<double> _file(_path, MatrixFile<double>::COPYONWRITE);
+        CHECK(_file.isOpen());
+        _file.writableMatrix()[0][2] = 99;
+        CHECK(_file.matrix()[0][2] == 99);
+    }
+    {
+        MatrixFile<double> _file(_path, MatrixFile<double>::READONLY, true);
+        CHECK(_file.isOpen() && equal(_file.matrix(), _matrix));
+    }
+
+    // the element type is part of the header
+    MatrixFile<float> _float(_path);
+    CHECK(!_float.isOpen());
+    std::remove(_path);
+}
+
+static void refusesDamagedFiles() {
+    const char * _path = "file_test_damaged.mat";
+    CHECK(MatrixFile<double>::write(_path, sample()));
+    MatrixFile<double>::Layout _layout;
+    MatrixFile<double>::layout(_path, _layout);
+    {
+        std::fstream _file(_path, std::ios::binary | std::ios::in | std::ios::out);
+        _file.seekp(_layout.dataOffset + 3);
+        _file.put('\x5a');
+    }
+    // the payload is only checked on request
+    CHECK(MatrixFile<double>(_path).isOpen());
+    CHECK(!MatrixFile<double>(_path, MatrixFile<double>::READONLY, true).isOpen());
+    {
+        std::fstream _file(_path, std::ios::binary | std::ios::in | std::ios::out);
+        _file.seekp(20);
+        _file.put('\x7f');
+    }
+    CHECK(!MatrixFile<double>(_path).isOpen());
+
+    // bounds whose extent overflows int, under a valid header checksum
+    CHECK(MatrixFile<double>::write(_path, sample()));
+    {
+        std::fstream _file(_path, std::ios::binary | std::ios::in | std::ios::out);
+        unsigned char _head[64];
+        _file.read(reinterpret_cast<char *>(_head), 64);
+        int32_t _low = std::numeric_limits<int32_t>::min(), _high = std::numeric_limits<int32_t>::max();
+        std::memcpy(_head + 12, & _low, 4);
+        std::memcpy(_head + 16, & _high, 4);
+        uint64_t _sum = MatrixFile<double>::checksum(_head, 56, 0);
+        std::memcpy(_head + 56, & _sum, 8);
+        _file.seekp(0);
+        _file.write(reinterpret_cast<const char *>(_head), 64);
+    }
+    MatrixFile<double>::Layout _wide;
+    CHECK(!MatrixFile<double>::layout(_path, _wide));
+    CHECK(!MatrixFile<double>(_path).isOpen());
+
+    writeText(_path, "short");
+    CHECK(!MatrixFile<double>(_path).isOpen());
+    std::remove(_path);
+    CHECK(!MatrixFile<double>(_path).isOpen());
+}
+
+static void sealsCreatedFile() {
+    const char * _path = "file_test_created.mat";
+    CHECK(MatrixFile<int>::create(_path, 1, 3, 0, 4));
+    MatrixFile<int>::Layout _layout;
+    CHECK(MatrixFile<int>::layout(_path, _layout));
+    {
+        // fill in row 2 with plain file I/O, as callers of create() do
+        std::fstream _file(_path, std::ios::binary | std::ios::in | std::ios::out);
+        _file.seekp(_layout.dataOffset + 5 * sizeof(int));
+        for (int col = 0; col <= 4; col++) _file.write(reinterpret_cast<const char *>(& col), sizeof(int));
+    }
+    CHECK(!MatrixFile<int>(_path, MatrixFile<int>::READONLY, true).isOpen());
+    CHECK(MatrixFile<int>::seal(_path));
+    MatrixFile<int> _file(_path, MatrixFile<int>::READONLY, true);
+    CHECK(_file.isOpen());
+    const SafeMatrix<int> & _matrix = _file.matrix();
+    CHECK(_matrix[1][4] == 0 && _matrix[2][0] == 0 && _matrix[2][4] == 4 && _matrix[3][3] == 0);
+    std::remove(_path);
+}
+
+static void readsWrittenText() {
+    const char * _path = "file_test.csv";
+    SafeMatrix<double> _matrix = sample();
+    CHECK(TextIO<double>::write(_path, _matrix));
+    SafeMatrix<double> _read;
+    CHECK(TextIO<double>::read(_path, _read, -1, 1));
+    CHECK(equal(_read, _matrix));
+
+    // a tab in the first line makes it TSV
+    CHECK(TextIO<double>::write(_path, _matrix, '\t'));
+    SafeMatrix<double> _tabs;
+    CHECK(TextIO<double>::read(_path, _tabs, -1, 1));
+    CHECK(equal(_tabs, _matrix));
+
+    SafeMatrix<long long> _extremes(0, 1);
+    _extremes[0][0] = std::numeric_limits<long long>::min();
+    _extremes[0][1] = std::numeric_limits<long long>::max();
+    CHECK(TextIO<long long>::write(_path, _extremes));
+    SafeMatrix<long long> _integers;
+    CHECK(TextIO<long long>::read(_path, _integers));
+    CHECK(equal(_integers, _extremes));
+    std::remove(_path);
+}
+
+static void readsLargeTextInParallel() {
+    const char * _path = "file_test_large.csv";
+    const int rows = 600, cols = 400;
+    SafeMatrix<int> _matrix(rows - 1, cols - 1);
+    for (int row = 0; row < rows; row++) {
+        int * _row = _matrix.rows()[row]->data();
+        for (int col = 0; col < cols; col++) _row[col] = (row * 7919 + col * 104729) % 2000003 - 1000000;
+    }
+    // more than one CHUNK of text, so line ends are searched on several threads
+    CHECK(TextIO<int>::write(_path, _matrix, ',', 4));
+    std::ifstream _in(_path, std::ios::binary | std::ios::ate);
+    CHECK((long) _in.tellg() > (1 << 20));
+    SafeMatrix<int> _read;
+    CHECK(TextIO<int>::read(_path, _read, 0, 0, 0, 4));
+    CHECK(equal(_read, _matrix));
+    std::remove(_path);
+}
+
+static void acceptsLooseTextAndRefusesBadLines() {
+    const char * _path = "file_test_loose.csv";
+    writeText(_path, " 1 , 2,3\r\n4,5 ,6\r\n\n");
+    SafeMatrix<int> _read;
+    CHECK(TextIO<int>::read(_path, _read));
+    CHECK(_read.rowHigh == 1 && _read.colHigh == 2);
+    const SafeMatrix<int> & _loose = _read;
+    CHECK(_loose[0][0] == 1 && _loose[0][2] == 3 && _loose[1][1] == 5 && _loose[1][2] == 6);
+
+    // no line end after the last line
+    writeText(_path, "7;8\n9;10");
+    CHECK(TextIO<int>::read(_path, _read, 0, 0, ';'));
+    CHECK(_loose[1][1] == 10);
+
+    // a short line or a stray character fails and leaves the result alone
+    writeText(_path, "1,2\n3\n");
+    CHECK(!TextIO<int>::read(_path, _read));
+    writeText(_path, "1,2\n3,x\n");
+    CHECK(!TextIO<int>::read(_path, _read));
+    CHECK(_loose[0][0] == 7 && _loose.colHigh == 1);
+    writeText(_path, "");
+    CHECK(!TextIO<int>::read(_path, _read));
+    std::remove(_path);
+}
+
+static void writesArraysAndTables() {
+    std::ostringstream _array;
+    SafeArray<int> a{ 1, -2, 3 };
+    CHECK(TextIO<int>::write(_array, a));
+    CHECK(_array.str() == "1,-2,3\n");
+
+    VNT<int> t(2, 2, 100);
+    for (int element : { 1, 2, 3 }) t.add(element);
+    std::ostringstream _table;
+    CHECK(TextIO<int>::write(_table, t, '\t'));
+    CHECK(_table.str() == "1\t2\n3\t--\n");
+}
+
+static void multipliesOutOfCore() {
+    const char * _a = "file_test_a.mat";
+    const char * _b = "file_test_b.mat";
+    const char * _c = "file_test_c.mat";
+    // small integers, so every sum is exact in any order and the products compare equal
+    SafeMatrix<double> a(1, 100, 0, 149);
+    SafeMatrix<double> b(-5, 144, 2, 81);
+    for (int row = 1; row <= 100; row++) {
+        for (int col = 0; col <= 149; col++) a[row][col] = (row * 31 + col * 17) % 19 - 9;
+    }
+    for (int row = -5; row <= 144; row++) {
+        for (int col = 2; col <= 81; col++) b[row][col] = (row * 13 + col * 7) % 23 - 11;
+    }
+    CHECK(MatrixFile<double>::write(_a, a));
+    CHECK(MatrixFile<double>::write(_b, b));
+
+    // a budget smaller than either operand, so several tiles pass along every dimension
+    const std::size_t _budget = 64 * 1024;
+    CHECK(_budget < 100 * 150 * sizeof(double) && _budget < 150 * 80 * sizeof(double));
+    OutOfCore<double>::Stats _stats;
+    CHECK(OutOfCore<double>::multiply(_a, _b, _c, _budget, & _stats));
+    CHECK(_stats.tileSize > 1 && _stats.tileSize < 80);
+    CHECK(_stats.bytesRead > 100 * 150 * sizeof(double) && _stats.bytesWritten == 100 * 80 * sizeof(double));
+
+    SafeMatrix<double> & _product = a * b;
+    {
+        MatrixFile<double> _file(_c, MatrixFile<double>::READONLY, true);
+        CHECK(_file.isOpen());
+        CHECK(equal(_file.matrix(), _product));
+    }
+    delete & _product;
+
+    // operands that do not chain are refused
+    CHECK(!OutOfCore<double>::multiply(_a, _a, _c, _budget));
+    std::remove(_a);
+    std::remove(_b);
+    std::remove(_c);
+}
+
+int main() {
+    mapsWrittenMatrix();
+    refusesDamagedFiles();
+    sealsCreatedFile();
+    readsWrittenText();
+    readsLargeTextInParallel();
+    acceptsLooseTextAndRefusesBadLines();
+    writesArraysAndTables();
+    multipliesOutOfCore();
+    return report("file_test");
+}
@@ -0,0 +1,110 @@
+/*
+ * LU factorization: determinant, solve for one and many right hand sides, inverse and singular matrices,
+ * on small systems with known answers and on a matrix large enough for the threaded path
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+
+#include <random>
+#include "LU.h"
+#include "Check.h"
+
+// largest |(A * X - B)[i][j]|, indices of X follow the columns of A
+static double residual(const SafeMatrix<double> & A, const SafeMatrix<double> & X, const SafeMatrix<double> & B) {
+    int n = A.rowHigh - A.rowLow + 1;
+    int cols = B.colHigh - B.colLow + 1;
+    double _largest = 0;
+    for (int i = 0; i < n; i++) {
+        const double * _a = A.matrix[i]->constData();
+        const double * _b = B.matrix[i]->constData();
+        for (int c = 0; c < cols; c++) {
+            double _sum = 0;
+            for (int p = 0; p < n; p++) _sum += _a[p] * X.matrix[p]->constData()[c];
+            _largest = std::fmax(_largest, std::fabs(_sum - _b[c]));
+        }
+    }
+    return _largest;
+}
+
+static void solvesKnownSystem() {
+    // needs a row exchange at the first step
+    SafeMatrix<double> A{ { 0, 2, 1 }, { 1, 1, 1 }, { 2, 1, 3 } };
+    SafeMatrix<double> factored = A;
+    LU<double> lu(factored);
+    CHECK(!lu.isSingular());
+    CHECK(near(lu.determinant(), -3));
+
+    // the copy was factored, A is untouched
+    const SafeMatrix<double> & _A = A;
+    CHECK(_A[0][0] == 0 && _A[2][2] == 3);
+
+    // x = (1, 2, 3)
+    SafeArray<double> b{ 7, 6, 13 };
+    SafeArray<double> x = lu.solve(b);
+    const SafeArray<double> & _x = x;
+    CHECK(near(_x[0], 1) && near(_x[1], 2) && near(_x[2], 3));
+}
+
+static void invertsKnownMatrix() {
+    SafeMatrix<double> A{ { 4, 7 }, { 2, 6 } };
+    SafeMatrix<double> factored = A;
+    LU<double> lu(factored);
+    SafeMatrix<double> inverse = lu.inverse();
+    const SafeMatrix<double> & _inverse = inverse;
+    CHECK(near(_inverse[0][0], 0.6) && near(_inverse[0][1], -0.7));
+    CHECK(near(_inverse[1][0], -0.2) && near(_inverse[1][1], 0.4));
+}
+
+static void keepsIndexBounds() {
+    SafeMatrix<double> A(1, 2, 1, 2);
+    A[1][1] = 2; A[1][2] = 1;
+    A[2][1] = 1; A[2][2] = 3;
+    SafeMatrix<double> factored = A;
+    LU<double> lu(factored);
+    SafeArray<double> b(1, 2);
+    b[1] = 5; b[2] = 10;
+    SafeArray<double> x = lu.solve(b);
+    CHECK(x.getLow() == 1 && x.getHigh() == 2);
+    const SafeArray<double> & _x = x;
+    CHECK(near(_x[1], 1) && near(_x[2], 3));
+}
+
+static void detectsSingularMatrix() {
+    SafeMatrix<double> A{ { 1, 2 }, { 2, 4 } };
+    LU<double> lu(A);
+    CHECK(lu.isSingular());
+    CHECK(lu.determinant() == 0);
+}
+
+static void solvesLargeSystem() {
+    const int n = 300;
+    std::mt19937 _random(7);
+    std::uniform_real_distribution<double> _value(-1, 1);
+    SafeMatrix<double> A(n - 1, n - 1);
+    SafeMatrix<double> B(n - 1, 3);
+    for (int i = 0; i < n; i++) {
+        double * _a = A.rows()[i]->data();
+        for (int j = 0; j < n; j++) _a[j] = _value(_random);
+        // diagonally dominant, so the residual is small however the pivots fall
+        _a[i] += n;
+        for (int c = 0; c < 4; c++) B.rows()[i]->data()[c] = _value(_random);
+    }
+    SafeMatrix<double> factored = A;
+    LU<double> lu(factored, 4);
+    SafeMatrix<double> X = lu.solve(B);
+    CHECK(residual(A, X, B) < 1e-10);
+
+    SafeMatrix<double> inverse = lu.inverse();
+    SafeMatrix<double> identity(n - 1, n - 1);
+    for (int i = 0; i < n; i++) identity.rows()[i]->data()[i] = 1;
+    CHECK(residual(A, inverse, identity) < 1e-10);
+}
+
+int main() {
+    solvesKnownSystem();
+    invertsKnownMatrix();
+    keepsIndexBounds();
+    detectsSingularMatrix();
+    solvesLargeSystem();
+    return report("lu_test");
+}
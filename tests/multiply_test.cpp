@@ -0,0 +1,222 @@
+/*
+ * Products outside SafeMatrix::operator*: the order MatrixChain plans for known chains and its products,
+ * compared with left to right operator* on small integers so every sum is exact in any order,
+ * and FixedMatrix arithmetic and BatchMultiply products compared with the same operations on SafeMatrix
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+
+#include <algorithm>
+#include <vector>
+#include "BatchMultiply.h"
+#include "FixedMatrix.h"
+#include "MatrixChain.h"
+#include "Check.h"
+
+// "l_rows" x "l_cols" matrix of small integers, different for every "l_seed"
+static SafeMatrix<double> * integers(int l_rows, int l_cols, int l_seed) {
+    SafeMatrix<double> * _matrix = new SafeMatrix<double>(l_rows - 1, l_cols - 1);
+    for (int row = 0; row < l_rows; row++) {
+        double * _row = _matrix->rows()[row]->data();
+        for (int col = 0; col < l_cols; col++) _row[col] = (row * 7 + col * 3 + l_seed * 5) % 11 - 5;
+    }
+    return _matrix;
+}
+
+template <typename T>
+static bool equal(const SafeMatrix<T> & a, const SafeMatrix<T> & b) {
+    if (a.rowHigh - a.rowLow != b.rowHigh - b.rowLow || a.colHigh - a.colLow != b.colHigh - b.colLow)
+        return false;
+    int cols = a.colHigh - a.colLow + 1;
+    for (int row = 0; row <= a.rowHigh - a.rowLow; row++) {
+        if (!std::equal(a.matrix[row]->constData(), a.matrix[row]->constData() + cols, b.matrix[row]->constData()))
+            return false;
+    }
+    return true;
+}
+
+// ((A0 * A1) * A2) * ... through operator*
+static SafeMatrix<double> leftToRight(SafeMatrix<double> * const * l_operands, int l_count) {
+    SafeMatrix<double> _product = * l_operands[0];
+    for (int i = 1; i < l_count; i++) {
+        SafeMatrix<double> & _next = _product * * l_operands[i];
+        _product = _next;
+        delete & _next;
+    }
+    return _product;
+}
+
+static void plansKnownChains() {
+    // tall times skinny first would build a 200 x 200 intermediate
+    SafeMatrix<double> * _tall[] = { integers(200, 2, 0), integers(2, 200, 1), integers(200, 2, 2) };
+    MatrixChain<double>::Plan _plan = MatrixChain<double>::plan(_tall, 3);
+    CHECK(_plan.order() == "(A0 (A1 A2))");
+    CHECK(_plan.cost() == 2 * 200 * 2 + 200 * 2 * 2);
+    CHECK(_plan.leftToRight() == 200 * 2 * 200 + 200 * 200 * 2);
+
+    // the textbook chain 40 x 20, 20 x 30, 30 x 10, 10 x 30
+    SafeMatrix<double> * _book[] = { integers(40, 20, 3), integers(20, 30, 4), integers(30, 10, 5),
+                                     integers(10, 30, 6) };
+    _plan = MatrixChain<double>::plan(_book, 4);
+    CHECK(_plan.order() == "((A0 (A1 A2)) A3)");
+    CHECK(_plan.cost() == 26000);
+
+    MatrixChain<double>::Plan _single = MatrixChain<double>::plan(_book, 1);
+    CHECK(_single.order() == "A0" && _single.cost() == 0);
+    for (SafeMatrix<double> * operand : _tall) delete operand;
+    for (SafeMatrix<double> * operand : _book) delete operand;
+}
+
+static void multipliesInPlannedOrder() {
+    // both halves of the last product are products, so they run side by side
+    SafeMatrix<double> * _chain[] = { integers(30, 60, 0), integers(60, 8, 1), integers(8, 60, 2),
+                                      integers(60, 25, 3) };
+    CHECK(MatrixChain<double>::plan(_chain, 4).order() == "((A0 A1) (A2 A3))");
+    SafeMatrix<double> _expected = leftToRight(_chain, 4);
+    for (int threads : { 1, 4 }) {
+        MatrixChain<double> _multiplier(threads);
+        // the result keeps its own bounds
+        SafeMatrix<double> _result(1, 30, -3, 21);
+        MatrixChain<double>::Plan _plan = _multiplier.multiply(_chain, 4, _result);
+        CHECK(_plan.cost() < _plan.leftToRight());
+        CHECK(_result.rowLow == 1 && _result.colLow == -3);
+        CHECK(equal(_result, _expected));
+
+        // a second call finds its intermediates in the scratch buffers of the first
+        int _buffers = _multiplier.scratchBuffers();
+        _result.fillMatrix(0);
+        _multiplier.multiply(_chain, 4, _result);
+        CHECK(_multiplier.scratchBuffers() == _buffers);
+        CHECK(equal(_result, _expected));
+    }
+
+    SafeMatrix<double> * _tall[] = { integers(120, 3, 4), integers(3, 120, 5), integers(120, 4, 6) };
+    MatrixChain<double> _multiplier;
+    SafeMatrix<double> _result(119, 3);
+    _multiplier.multiply(_tall, 3, _result);
+    CHECK(equal(_result, leftToRight(_tall, 3)));
+
+    // a chain of one copies its operand
+    SafeMatrix<double> _copy(29, 59);
+    _multiplier.multiply(_chain, 1, _copy);
+    CHECK(equal(_copy, * _chain[0]));
+    for (SafeMatrix<double> * operand : _chain) delete operand;
+    for (SafeMatrix<double> * operand : _tall) delete operand;
+}
+
+// every element of "l_fixed" equals the element of "l_SafeMatrix" at the same indices
+template <typename T, int RL, int RH, int CL, int CH>
+static bool same(const FixedMatrix<T, RL, RH, CL, CH> & l_fixed, const SafeMatrix<T> & l_SafeMatrix) {
+    if (l_SafeMatrix.rowLow != RL || l_SafeMatrix.rowHigh != RH || l_SafeMatrix.colLow != CL || l_SafeMatrix.colHigh != CH)
+        return false;
+    for (int row = RL; row <= RH; row++) {
+        for (int col = CL; col <= CH; col++) {
+            if (l_fixed[row][col] != l_SafeMatrix[row][col]) return false;
+        }
+    }
+    return true;
+}
+
+template <typename T, int RL, int RH, int CL, int CH>
+static void fillBoth(FixedMatrix<T, RL, RH, CL, CH> & l_fixed, SafeMatrix<T> & l_SafeMatrix, int l_seed) {
+    for (int row = RL; row <= RH; row++) {
+        for (int col = CL; col <= CH; col++) {
+            l_fixed[row][col] = l_SafeMatrix[row][col] = (T) ((row * 5 + col * 3 + l_seed) % 9 - 4);
+        }
+    }
+}
+
+template <typename T, int N, int LOW>
+static void matchesSafeMatrix() {
+    typedef FixedMatrix<T, LOW, LOW + N - 1, LOW, LOW + N - 1> Square;
+    Square a, b;
+    SafeMatrix<T> _a(LOW, LOW + N - 1, LOW, LOW + N - 1), _b(LOW, LOW + N - 1, LOW, LOW + N - 1);
+    fillBoth(a, _a, 1);
+    fillBoth(b, _b, 6);
+
+    SafeMatrix<T> & _product = _a * _b;
+    CHECK(same(a * b, _product));
+    SafeMatrix<T> & _sum = _a + _b;
+    CHECK(same(a + b, _sum));
+    SafeMatrix<T> & _difference = _a - _b;
+    CHECK(same(a - b, _difference));
+    delete & _product;
+    delete & _sum;
+    delete & _difference;
+
+    Square t = a.transpose();
+    bool _transposed = true;
+    for (int row = LOW; row < LOW + N; row++) {
+        for (int col = LOW; col < LOW + N; col++) _transposed = _transposed && t[col][row] == _a[row][col];
+    }
+    CHECK(_transposed);
+    Square _left = (a * b).transpose(), _right = b.transpose() * a.transpose();
+    CHECK(std::equal(& _left.data[0][0], & _left.data[0][0] + N * N, & _right.data[0][0]));
+}
+
+static void fixedMatchesSafeMatrix() {
+    matchesSafeMatrix<double, 3, 0>();
+    matchesSafeMatrix<double, 4, 1>();
+    matchesSafeMatrix<int, 3, -1>();
+    matchesSafeMatrix<float, 4, 0>();
+
+    // rectangular operands take the column bounds of the right operand
+    FixedMatrix<double, 0, 1, 0, 2> r{ { 1, 2, 3 }, { 4, 5, 6 } };
+    FixedMatrix<double, 1, 3, 5, 6> s{ { 1, 0 }, { 0, 1 }, { 2, -1 } };
+    SafeMatrix<double> _r{ { 1, 2, 3 }, { 4, 5, 6 } };
+    SafeMatrix<double> _s(1, 3, 5, 6);
+    _s[1][5] = 1; _s[2][6] = 1; _s[3][5] = 2; _s[3][6] = -1;
+    SafeMatrix<double> & _rs = _r * _s;
+    CHECK(same(r * s, _rs));
+    delete & _rs;
+
+    // the unrolled operations are usable in constant expressions
+    constexpr FixedMatrix<int, 0, 1, 0, 1> c{ { 1, 2 }, { 3, 4 } };
+    static_assert((c * c).at<1, 1>() == 22 && (c + c).at<0, 1>() == 4 && c.transpose().at<0, 1>() == 3,
+                  "FixedMatrix constant evaluation");
+}
+
+static void batchMatchesOperator() {
+    // more than one slice of 256 matrices, the last one partial
+    const long _batch = 300;
+    const int m = 3, k = 4, n = 2;
+    std::vector<SafeMatrix<double> *> a, b, c;
+    for (long index = 0; index < _batch; index++) {
+        a.push_back(integers(m, k, (int) index));
+        b.push_back(integers(k, n, (int) index + 3));
+        c.push_back(new SafeMatrix<double>(m - 1, n - 1));
+    }
+    std::vector<double> _a(m * k * _batch), _b(k * n * _batch), _c(m * n * _batch);
+    BatchMultiply<double>::pack(a.data(), _batch, _a.data());
+    BatchMultiply<double>::pack(b.data(), _batch, _b.data());
+    for (int threads : { 1, 4 }) {
+        std::fill(_c.begin(), _c.end(), -1.0);
+        BatchMultiply<double>::multiply(_a.data(), _b.data(), _c.data(), m, k, n, _batch, threads);
+        BatchMultiply<double>::unpack(_c.data(), _batch, c.data());
+        bool _equal = true;
+        for (long index = 0; index < _batch; index++) {
+            SafeMatrix<double> & _product = * a[index] * * b[index];
+            _equal = _equal && equal(* c[index], _product);
+            delete & _product;
+        }
+        CHECK(_equal);
+    }
+
+    // an empty batch touches neither the matrices nor the data
+    BatchMultiply<double>::pack(nullptr, 0, nullptr);
+    BatchMultiply<double>::unpack(nullptr, 0, nullptr);
+    BatchMultiply<double>::multiply(nullptr, nullptr, nullptr, m, k, n, 0);
+    for (long index = 0; index < _batch; index++) {
+        delete a[index];
+        delete b[index];
+        delete c[index];
+    }
+}
+
+int main() {
+    plansKnownChains();
+    multipliesInPlannedOrder();
+    fixedMatchesSafeMatrix();
+    batchMatchesOperator();
+    return report("multiply_test");
+}
@@ -0,0 +1,131 @@
+/*
+ * Reduce: sums, dot products, extremes, scans and row and column reductions are bit for bit the same
+ * at 1 and 8 threads on arrays many blocks long, and close to a long double reference.
+ * Parallel: every chunk runs once, also for calls made from several threads and from inside a chunk.
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+#include "Reduce.h"
+#include "Check.h"
+
+typedef Reduce<double> R;
+
+// longer than BLOCK * BLOCKGRAIN many times over and not a multiple of a block
+static const int SIZE = 300007;
+
+// values of many magnitudes and both signs, so the order of additions changes the rounded result
+static SafeArray<double> values(int l_low, int l_size, unsigned l_seed) {
+    std::mt19937 _random(l_seed);
+    std::uniform_real_distribution<double> _mantissa(-1, 1);
+    std::uniform_int_distribution<int> _exponent(-20, 20);
+    SafeArray<double> _array(l_low, l_low + l_size - 1);
+    double * _data = _array.data();
+    for (int i = 0; i < l_size; i++) _data[i] = std::ldexp(_mantissa(_random), _exponent(_random));
+    return _array;
+}
+
+static bool identical(const SafeArray<double> & a, const SafeArray<double> & b) {
+    if (a.getLow() != b.getLow() || a.getHigh() != b.getHigh()) return false;
+    return std::equal(a.constData(), a.constData() + (a.getHigh() - a.getLow() + 1), b.constData());
+}
+
+static void arraysIgnoreThreadCount() {
+    SafeArray<double> a = values(-5, SIZE, 1), b = values(0, SIZE, 2);
+    long double _sum = 0, _dot = 0;
+    for (int i = 0; i < SIZE; i++) {
+        _sum += a.constData()[i];
+        _dot += (long double) a.constData()[i] * b.constData()[i];
+    }
+    CHECK(R::sum(a, 1) == R::sum(a, 8));
+    CHECK(near(R::sum(a, 1), (double) _sum, 1e-12));
+    CHECK(R::dot(a, b, 1) == R::dot(a, b, 8));
+    CHECK(near(R::dot(a, b, 1), (double) _dot, 1e-12));
+    CHECK(R::norm1(a, 1) == R::norm1(a, 8));
+    CHECK(R::norm2(a, 1) == R::norm2(a, 8));
+    CHECK(R::normInf(a, 1) == R::normInf(a, 8));
+
+    // the first of equal extremes, whichever thread finds it
+    a[1000] = a[250000] = 1e9;
+    a[77] = a[200001] = -1e9;
+    CHECK(R::max(a, 8).index == 1000 && R::max(a, 1).index == 1000 && R::max(a, 8).value == 1e9);
+    CHECK(R::min(a, 8).index == 77 && R::min(a, 1).index == 77);
+
+    SafeArray<double> _one(-5, SIZE - 6), _eight(-5, SIZE - 6);
+    R::inclusiveScan(a, _one, 1);
+    R::inclusiveScan(a, _eight, 8);
+    CHECK(identical(_one, _eight));
+    CHECK(near(_one[SIZE - 6], R::sum(a), 1e-9));
+    R::exclusiveScan(a, _one, 3.5, 1);
+    R::exclusiveScan(a, _eight, 3.5, 8);
+    CHECK(identical(_one, _eight));
+    CHECK(_one[-5] == 3.5);
+
+    // in place
+    SafeArray<double> _inPlace = a;
+    R::inclusiveScan(_inPlace, _inPlace, 8);
+    R::inclusiveScan(a, _one, 1);
+    CHECK(identical(_inPlace, _one));
+}
+
+static void matricesIgnoreThreadCount() {
+    // enough rows and columns that both row and column reductions split across 8 threads
+    const int m = 70, n = 3001;
+    SafeMatrix<double> a(1, m, -2, n - 3);
+    for (int row = 0; row < m; row++) {
+        SafeArray<double> _row = values(0, n, 10 + row);
+        std::copy(_row.constData(), _row.constData() + n, a.rows()[row]->data());
+    }
+    CHECK(R::sum(a, 1) == R::sum(a, 8));
+    CHECK(R::norm(a, 1) == R::norm(a, 8));
+    for (R::Operation operation : { R::SUM, R::MIN, R::MAX }) {
+        CHECK(identical(R::rows(a, operation, 1), R::rows(a, operation, 8)));
+        CHECK(identical(R::columns(a, operation, 1), R::columns(a, operation, 8)));
+    }
+    SafeArray<double> _rows = R::rows(a, R::SUM, 8);
+    SafeArray<double> _columns = R::columns(a, R::SUM, 8);
+    CHECK(_rows.getLow() == 1 && _columns.getLow() == -2);
+    const SafeMatrix<double> & _a = a;
+    double _column = 0;
+    for (int row = 1; row <= m; row++) _column += _a[row][100];
+    CHECK(_columns[100] == _column);
+}
+
+static void parallelRunsEveryChunk() {
+    const long _count = 100000;
+    std::vector<std::atomic<int>> _visits(_count);
+    // callers on several threads at once, each chunk starting a call of its own
+    std::vector<std::thread> _callers;
+    for (int caller = 0; caller < 4; caller++) {
+        _callers.emplace_back([&, caller] {
+            long _low = caller * _count / 4, _high = (caller + 1) * _count / 4;
+            Parallel::forRange(_low, _high, 4, 1000, [&](long l_low, long l_high) {
+                Parallel::forRange(l_low, l_high, 3, 100, [&](long l_first, long l_last) {
+                    for (long index = l_first; index < l_last; index++) _visits[index]++;
+                });
+            });
+        });
+    }
+    for (std::thread & caller : _callers) caller.join();
+    bool _once = true;
+    for (std::atomic<int> & visits : _visits) _once = _once && visits == 1;
+    CHECK(_once);
+
+    // a range too short for its grain runs on the calling thread
+    std::thread::id _caller = std::this_thread::get_id(), _ran;
+    Parallel::forRange(0, 10, 8, 100, [&](long, long) { _ran = std::this_thread::get_id(); });
+    CHECK(_ran == _caller);
+}
+
+int main() {
+    arraysIgnoreThreadCount();
+    matricesIgnoreThreadCount();
+    parallelRunsEveryChunk();
+    return report("reduce_test");
+}
@@ -0,0 +1,149 @@
+/*
+ * Copy-on-write of SafeArray and SafeMatrix: copies share until written and never see writes of each other
+ * made through operator[], rows() or a reference or pointer taken after the copy
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+
+#include "SafeMatrix.h"
+#include "BlockResource.h"
+#include "Check.h"
+
+static void copiesShareUntilWritten() {
+    SafeArray<int> a{ 1, 2, 3 };
+    SafeArray<int> b = a;
+    const SafeArray<int> & _a = a;
+    const SafeArray<int> & _b = b;
+    CHECK(_a.isShared() && _b.isShared());
+    CHECK(_a.constData() == _b.constData());
+
+    b[0] = 9;
+    CHECK(!_a.isShared() && !_b.isShared());
+    CHECK(_a[0] == 1 && _b[0] == 9);
+    CHECK(_a[1] == 2 && _b[1] == 2);
+}
+
+static void referenceTakenAfterCopyIsIsolated() {
+    SafeArray<int> a(2);
+    a[0] = 1;
+    SafeArray<int> b = a;
+    // a copy invalidates earlier references, one taken after it writes to its own array only
+    int & r = a[0];
+    r = 5;
+    const SafeArray<int> & _a = a;
+    const SafeArray<int> & _b = b;
+    CHECK(_a[0] == 5 && _b[0] == 1);
+    CHECK(!_a.isShared() && !_b.isShared());
+}
+
+static void pointerTakenAfterCopyIsIsolated() {
+    SafeArray<int> a(2);
+    a.data()[1] = 7;
+    SafeArray<int> b = a;
+    const SafeArray<int> & _b = b;
+    CHECK(_b.isShared());
+    int * p = a.data();
+    p[1] = 8;
+    CHECK(_b[1] == 7);
+
+    // writing does not stop later copies from sharing
+    SafeArray<int> c = a;
+    const SafeArray<int> & _c = c;
+    CHECK(_c.isShared() && _c[1] == 8);
+}
+
+static void assignmentShares() {
+    SafeArray<int> source{ 4, 5 };
+    SafeArray<int> a(1);
+    a = source;
+    SafeArray<int> b = a;
+    const SafeArray<int> & _a = a;
+    const SafeArray<int> & _b = b;
+    CHECK(_a.isShared() && _b.isShared());
+    CHECK(_b[0] == 4 && _b[1] == 5);
+}
+
+static void constReadsDoNotDetach() {
+    SafeArray<int> a{ 1, 2 };
+    SafeArray<int> b = a;
+    const SafeArray<int> & _b = b;
+    int _sum = _b[0] + _b[1] + _b.data()[0];
+    CHECK(_sum == 4);
+    CHECK(_b.isShared());
+}
+
+static void viewsCopyTheirElements() {
+    int _buffer[3] = { 1, 2, 3 };
+    SafeArray<int> view(_buffer, 1, 3);
+    SafeArray<int> copy = view;
+    copy[1] = 9;
+    CHECK(_buffer[0] == 1);
+    CHECK(view[1] == 1 && copy[1] == 9 && copy[3] == 3);
+}
+
+static void matrixCopiesShareTheTable() {
+    SafeMatrix<int> m{ { 1, 2 }, { 3, 4 } };
+    m[1][1] = 5;
+    SafeMatrix<int> n = m;
+    const SafeMatrix<int> & _m = m;
+    const SafeMatrix<int> & _n = n;
+    CHECK(_m.isShared() && _n.isShared());
+    CHECK(_m.matrix == _n.matrix);
+
+    // the first write gives the writer a table of its own, rows still share until written
+    n[0][0] = 9;
+    CHECK(!_m.isShared() && !_n.isShared());
+    CHECK(_m.matrix != _n.matrix);
+    CHECK(_m[0][0] == 1 && _n[0][0] == 9);
+    CHECK(_n[1].isShared() && _n[1][1] == 5);
+
+    // a row pointer taken after the copy writes to its own matrix only
+    SafeMatrix<int> c = m;
+    int * _row = m.rows()[1]->data();
+    _row[0] = 8;
+    const SafeMatrix<int> & _c = c;
+    CHECK(_m[1][0] == 8 && _c[1][0] == 3);
+
+    // assignment shares as well
+    SafeMatrix<int> d;
+    d = m;
+    const SafeMatrix<int> & _d = d;
+    CHECK(_d.isShared() && _d[1][0] == 8);
+}
+
+static void viewMatrixCopiesItsElements() {
+    int _buffer[4] = { 1, 2, 3, 4 };
+    SafeMatrix<int> * _view = new SafeMatrix<int>(_buffer, 0, 1, 0, 1);
+    SafeMatrix<int> _copy = * _view;
+    delete _view;
+    _buffer[0] = 9;
+    const SafeMatrix<int> & _c = _copy;
+    CHECK(!_c.isShared() && _c[0][0] == 1 && _c[1][1] == 4);
+}
+
+static void copiesKeepTheirResource() {
+    BlockResource<long> _resource;
+    {
+        SafeArray<int> a(0, 9, & _resource);
+        a[3] = 3;
+        SafeArray<int> b = a;
+        b[4] = 4;
+        CHECK(b.getResource() == & _resource);
+        CHECK(a[4] == 0 && b[3] == 3 && b[4] == 4);
+        CHECK(_resource.getStatistics().allocations == 2);
+    }
+    CHECK(_resource.getStatistics().bytes == 0);
+}
+
+int main() {
+    copiesShareUntilWritten();
+    referenceTakenAfterCopyIsIsolated();
+    pointerTakenAfterCopyIsIsolated();
+    assignmentShares();
+    constReadsDoNotDetach();
+    viewsCopyTheirElements();
+    matrixCopiesShareTheTable();
+    viewMatrixCopiesItsElements();
+    copiesKeepTheirResource();
+    return report("safearray_test");
+}
@@ -0,0 +1,126 @@
+/*
+ * Slab and SlabArray: distinct aligned objects cut in address order, LIFO reuse, chunks reused across threads,
+ * objects freed by another thread, and the SafeArray / SafeMatrix objects that come from Slab
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+#include "SafeMatrix.h"
+#include "Check.h"
+
+// a size and alignment no library type uses, so the pool starts empty
+typedef Slab<48, 16> Pool;
+
+static void cutsAlignedObjectsInOrder() {
+    std::vector<void *> _objects;
+    for (int i = 0; i < 100; i++) _objects.push_back(Pool::allocate());
+    CHECK(Pool::chunks() == 1);
+    std::set<void *> _distinct(_objects.begin(), _objects.end());
+    CHECK(_distinct.size() == _objects.size());
+    bool _aligned = true, _ordered = true;
+    for (std::size_t i = 0; i < _objects.size(); i++) {
+        _aligned = _aligned && reinterpret_cast<uintptr_t>(_objects[i]) % 16 == 0;
+        if (i > 0) _ordered = _ordered && _objects[i] == static_cast<char *>(_objects[i - 1]) + 48;
+        std::memset(_objects[i], (int) i, 48);
+    }
+    CHECK(_aligned);
+    CHECK(_ordered);
+    bool _intact = true;
+    for (std::size_t i = 0; i < _objects.size(); i++) {
+        _intact = _intact && static_cast<unsigned char *>(_objects[i])[47] == (unsigned char) i;
+    }
+    CHECK(_intact);
+
+    // the last object freed is the next one handed out
+    Pool::deallocate(_objects[40]);
+    CHECK(Pool::allocate() == _objects[40]);
+    for (void * object : _objects) Pool::deallocate(object);
+}
+
+static void reusesObjectsOfFinishedThreads() {
+    const int _count = 2000;
+    std::thread _worker([&] {
+        std::vector<void *> _objects;
+        for (int i = 0; i < _count; i++) _objects.push_back(Pool::allocate());
+        for (void * object : _objects) Pool::deallocate(object);
+    });
+    _worker.join();
+    std::size_t _chunks = Pool::chunks();
+    std::vector<void *> _objects;
+    for (int i = 0; i < _count; i++) _objects.push_back(Pool::allocate());
+    CHECK(Pool::chunks() == _chunks);
+    for (void * object : _objects) Pool::deallocate(object);
+}
+
+static void freesObjectsOfOtherThreads() {
+    std::vector<int *> _objects;
+    for (int i = 0; i < 500; i++) {
+        int * _object = static_cast<int *>(Pool::allocate());
+        * _object = i;
+        _objects.push_back(_object);
+    }
+    bool _intact = true;
+    std::thread _worker([&] {
+        for (int i = 0; i < 500; i++) {
+            _intact = _intact && * _objects[i] == i;
+            Pool::deallocate(_objects[i]);
+        }
+    });
+    _worker.join();
+    CHECK(_intact);
+}
+
+static void sizesArraysByClass() {
+    CHECK(SlabArray<long>::allocate(0) == nullptr);
+    bool _intact = true;
+    for (std::size_t count : { 1, 3, 64, 512, 513, 5000 }) {
+        long * _array = SlabArray<long>::allocate(count);
+        for (std::size_t i = 0; i < count; i++) _array[i] = (long) (count + i);
+        for (std::size_t i = 0; i < count; i++) _intact = _intact && _array[i] == (long) (count + i);
+        SlabArray<long>::deallocate(_array, count);
+    }
+    CHECK(_intact);
+
+    // counts of one size class share a pool
+    long * _three = SlabArray<long>::allocate(3);
+    SlabArray<long>::deallocate(_three, 3);
+    CHECK(SlabArray<long>::allocate(4) == _three);
+    SlabArray<long>::deallocate(_three, 4);
+}
+
+static void holdsArrayAndMatrixObjects() {
+    // no SafeArray object was freed on this thread yet, so the rows of a new matrix are cut one after the other
+    SafeMatrix<short> * _matrix = new SafeMatrix<short>(0, 3, 0, 3);
+    bool _adjacent = true;
+    for (int row = 1; row < 4; row++) _adjacent = _adjacent && _matrix->matrix[row] == _matrix->matrix[row - 1] + 1;
+    CHECK(_adjacent);
+    (* _matrix)[3][3] = 7;
+    CHECK((* _matrix)[3][3] == 7);
+    delete _matrix;
+
+    // the last array object freed is the next one handed out
+    typedef Slab<sizeof(SafeArray<int>), alignof(SafeArray<int>)> ArrayPool;
+    CHECK(ArrayPool::chunks() >= 1);
+    SafeArray<int> * _array = new SafeArray<int>(3);
+    SafeArray<int> * _next = new SafeArray<int>(3);
+    CHECK(_array != _next);
+    delete _next;
+    delete _array;
+    SafeArray<int> * _again = new SafeArray<int>(1);
+    CHECK(_again == _array);
+    delete _again;
+}
+
+int main() {
+    cutsAlignedObjectsInOrder();
+    reusesObjectsOfFinishedThreads();
+    freesObjectsOfOtherThreads();
+    sizesArraysByClass();
+    holdsArrayAndMatrixObjects();
+    return report("slab_test");
+}
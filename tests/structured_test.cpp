@@ -0,0 +1,172 @@
+/*
+ * StructuredMatrix: packed indexing, expand(), matrix-vector and matrix-matrix products for every structure,
+ * each compared with the dense matrix the structure keeps and a dense product through SafeMatrix operator*.
+ * Elements are small integers so the products compare exactly.
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+
+#include <algorithm>
+#include <utility>
+#include "StructuredMatrix.h"
+#include "Check.h"
+
+typedef StructuredMatrix<double> Matrix;
+
+static const int LOW = 2, HIGH = 8;
+
+// dense matrix over LOW..HIGH without zeros, different for every "l_seed"
+static SafeMatrix<double> dense(int l_seed, int l_cols = HIGH - LOW + 1) {
+    SafeMatrix<double> _matrix(LOW, HIGH, 0, l_cols - 1);
+    for (int row = LOW; row <= HIGH; row++) {
+        for (int col = 0; col < l_cols; col++) _matrix[row][col] = (row * 5 + col * 3 + l_seed) % 9 + 1;
+    }
+    return _matrix;
+}
+
+// "l_dense" with every element the structure does not keep set to zero, SYMMETRIC mirrors the lower triangle
+static SafeMatrix<double> kept(const SafeMatrix<double> & l_dense, Matrix::Structure l_structure,
+                               int l_lower = 0, int l_upper = 0) {
+    SafeMatrix<double> _kept(LOW, HIGH, LOW, HIGH);
+    for (int row = LOW; row <= HIGH; row++) {
+        for (int col = LOW; col <= HIGH; col++) {
+            int i = row - LOW, j = col - LOW;
+            bool _stored = l_structure == Matrix::SYMMETRIC
+                           || (l_structure == Matrix::LOWER && j <= i)
+                           || (l_structure == Matrix::UPPER && j >= i)
+                           || (l_structure == Matrix::BANDED && j >= i - l_lower && j <= i + l_upper);
+            int _row = l_structure == Matrix::SYMMETRIC ? std::max(i, j) : i;
+            int _col = l_structure == Matrix::SYMMETRIC ? std::min(i, j) : j;
+            _kept[row][col] = _stored ? l_dense[LOW + _row][_col] : 0;
+        }
+    }
+    return _kept;
+}
+
+template <typename T>
+static bool equal(const SafeMatrix<T> & a, const SafeMatrix<T> & b) {
+    if (a.rowHigh - a.rowLow != b.rowHigh - b.rowLow || a.colHigh - a.colLow != b.colHigh - b.colLow)
+        return false;
+    int cols = a.colHigh - a.colLow + 1;
+    for (int row = 0; row <= a.rowHigh - a.rowLow; row++) {
+        if (!std::equal(a.matrix[row]->constData(), a.matrix[row]->constData() + cols, b.matrix[row]->constData()))
+            return false;
+    }
+    return true;
+}
+
+// indexing, expand() and both products of "l_matrix" against the dense matrix "l_expected"
+static void matchesDense(const Matrix & l_matrix, SafeMatrix<double> & l_expected) {
+    bool _indexed = true;
+    for (int row = LOW; row <= HIGH; row++) {
+        for (int col = LOW; col <= HIGH; col++) {
+            _indexed = _indexed && (double) l_matrix[row][col] == l_expected[row][col];
+        }
+    }
+    CHECK(_indexed);
+    SafeMatrix<double> _expanded(LOW, HIGH, LOW, HIGH);
+    l_matrix.expand(_expanded);
+    CHECK(equal(_expanded, l_expected));
+
+    // y = a * x, x over other bounds of the same length
+    SafeArray<double> x(-3, HIGH - LOW - 3);
+    for (int i = x.getLow(); i <= x.getHigh(); i++) x[i] = i % 4 - 1;
+    SafeArray<double> y = l_matrix * x;
+    CHECK(y.getLow() == LOW && y.getHigh() == HIGH);
+    bool _vector = true;
+    for (int row = LOW; row <= HIGH; row++) {
+        double _sum = 0;
+        for (int col = LOW; col <= HIGH; col++) _sum += l_expected[row][col] * x[x.getLow() + col - LOW];
+        _vector = _vector && y[row] == _sum;
+    }
+    CHECK(_vector);
+
+    // c = a * b for a dense b of 4 columns
+    SafeMatrix<double> b = dense(7, 4);
+    SafeMatrix<double> c(LOW, HIGH, 0, 3);
+    c.fillMatrix(-1);
+    l_matrix.multiply(b, c);
+    SafeMatrix<double> & _product = l_expected * b;
+    CHECK(equal(c, _product));
+    delete & _product;
+}
+
+static void symmetricMatchesDense() {
+    SafeMatrix<double> _dense = dense(1);
+    Matrix a(_dense, Matrix::SYMMETRIC);
+    CHECK(a.storage() == 7 * 8 / 2);
+    SafeMatrix<double> _expected = kept(_dense, Matrix::SYMMETRIC);
+    matchesDense(a, _expected);
+
+    // both halves name the same element
+    a[3][6] = 40;
+    CHECK((double) a[6][3] == 40);
+    _expected[3][6] = _expected[6][3] = 40;
+    matchesDense(a, _expected);
+}
+
+static void lowerMatchesDense() {
+    SafeMatrix<double> _dense = dense(2);
+    Matrix a(_dense, Matrix::LOWER);
+    CHECK(a.storage() == 7 * 8 / 2 && a.upperBandwidth() == 0);
+    SafeMatrix<double> _expected = kept(_dense, Matrix::LOWER);
+    matchesDense(a, _expected);
+
+    // zero may be written above the diagonal, it is not stored
+    a[2][8] = 0;
+    CHECK((double) a[2][8] == 0);
+}
+
+static void upperMatchesDense() {
+    SafeMatrix<double> _dense = dense(3);
+    Matrix a(_dense, Matrix::UPPER);
+    CHECK(a.storage() == 7 * 8 / 2 && a.lowerBandwidth() == 0);
+    SafeMatrix<double> _expected = kept(_dense, Matrix::UPPER);
+    matchesDense(a, _expected);
+
+    // the first and last element of every packed row
+    for (int row = LOW; row <= HIGH; row++) {
+        a[row][row] = 100 + row;
+        a[row][HIGH] += 200;
+        _expected[row][row] = 100 + row;
+        _expected[row][HIGH] += 200;
+    }
+    matchesDense(a, _expected);
+}
+
+static void bandedMatchesDense() {
+    SafeMatrix<double> _dense = dense(4);
+    for (std::pair<int, int> band : { std::make_pair(1, 2), std::make_pair(3, 0), std::make_pair(0, 0) }) {
+        Matrix a(_dense, band.first, band.second);
+        CHECK(a.storage() == 7u * (band.first + band.second + 1));
+        CHECK(a.lowerBandwidth() == band.first && a.upperBandwidth() == band.second);
+        SafeMatrix<double> _expected = kept(_dense, Matrix::BANDED, band.first, band.second);
+        matchesDense(a, _expected);
+    }
+
+    // a band wider than the matrix runs off both edges and is cut to n - 1 diagonals
+    Matrix a(_dense, 10, 9);
+    CHECK(a.lowerBandwidth() == 6 && a.upperBandwidth() == 6 && a.storage() == 7 * 13);
+    SafeMatrix<double> _expected = kept(_dense, Matrix::BANDED, 6, 6);
+    matchesDense(a, _expected);
+    a[LOW][HIGH] = 50;
+    a[HIGH][LOW] = 60;
+    _expected[LOW][HIGH] = 50;
+    _expected[HIGH][LOW] = 60;
+    matchesDense(a, _expected);
+
+    // copies keep the structure and the elements
+    Matrix _copy = a;
+    matchesDense(_copy, _expected);
+    Matrix _assigned(0, 0, Matrix::LOWER);
+    _assigned = a;
+    matchesDense(_assigned, _expected);
+}
+
+int main() {
+    symmetricMatchesDense();
+    lowerMatchesDense();
+    upperMatchesDense();
+    bandedMatchesDense();
+    return report("structured_test");
+}
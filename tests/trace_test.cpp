@@ -0,0 +1,263 @@
+/*
+ * Trace: flush() writes valid JSON in which every thread's B and E events pair up with matching names,
+ * instant events and their arguments survive, a full ring keeps its newest events and a flush while
+ * other threads record stays valid. Tracing is compiled in here whatever the build options.
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+#define SAFEARRAY_TRACE true
+#define SAFEARRAY_TRACE_CAPACITY 4096
+
+#include <atomic>
+#include <cctype>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "VNT.h"
+#include "Check.h"
+
+// a JSON value, objects keep their members in order
+struct Json {
+    char type = 0;  // 'o'bject, 'a'rray, 's'tring, 'n'umber, 'l'iteral
+    std::string text;
+    std::vector<std::pair<std::string, Json>> members;
+    std::vector<Json> items;
+
+    const Json * member(const std::string & l_name) const {
+        for (const std::pair<std::string, Json> & member : members) {
+            if (member.first == l_name) return & member.second;
+        }
+        return nullptr;
+    }
+};
+
+// strict enough for the trace format: no trailing commas, quoted names, nothing after the value
+class Parser {
+private:
+    const std::string & text;
+    std::size_t next = 0;
+
+public:
+    explicit Parser(const std::string & l_text) : text(l_text) { }
+
+    bool parse(Json & l_value) {
+        if (!value(l_value)) return false;
+        space();
+        return next == text.size();
+    }
+
+private:
+    void space() {
+        while (next < text.size() && std::isspace((unsigned char) text[next])) next++;
+    }
+
+    bool expect(char l_character) {
+        space();
+        if (next >= text.size() || text[next] != l_character) return false;
+        next++;
+        return true;
+    }
+
+    bool string(std::string & l_text) {
+        if (!expect('"')) return false;
+        while (next < text.size() && text[next] != '"') {
+            if (text[next] == '\\') next++;
+            if ((unsigned char) text[next] < 0x20) return false;
+            l_text += text[next++];
+        }
+        return expect('"');
+    }
+
+    bool value(Json & l_value) {
+        space();
+        if (next >= text.size()) return false;
+        char _first = text[next];
+        if (_first == '{') {
+            l_value.type = 'o';
+            next++;
+            if (expect('}')) return true;
+            do {
+                std::pair<std::string, Json> _member;
+                if (!string(_member.first) || !expect(':') || !value(_member.second)) return false;
+                l_value.members.push_back(_member);
+            } while (expect(','));
+            return expect('}');
+        }
+        if (_first == '[') {
+            l_value.type = 'a';
+            next++;
+            if (expect(']')) return true;
+            do {
+                l_value.items.emplace_back();
+                if (!value(l_value.items.back())) return false;
+            } while (expect(','));
+            return expect(']');
+        }
+        if (_first == '"') {
+            l_value.type = 's';
+            return string(l_value.text);
+        }
+        if (_first == '-' || std::isdigit((unsigned char) _first)) {
+            l_value.type = 'n';
+            std::size_t _end = next + (_first == '-');
+            while (_end < text.size() && (std::isdigit((unsigned char) text[_end]) || text[_end] == '.'
+                                          || text[_end] == 'e' || text[_end] == 'E' || text[_end] == '+'
+                                          || text[_end] == '-'))
+                _end++;
+            l_value.text = text.substr(next, _end - next);
+            next = _end;
+            return l_value.text != "-";
+        }
+        for (const char * literal : { "true", "false", "null" }) {
+            if (text.compare(next, std::string(literal).size(), literal) == 0) {
+                l_value.type = 'l';
+                next += std::string(literal).size();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct Summary {
+    bool valid = false;
+    bool paired = true;
+    bool ordered = true;
+    int scopes = 0;
+    std::map<std::string, int> instants;
+};
+
+// parse a flush and check that B and E nest per thread with matching names and ascending times
+static Summary summarize(const std::string & l_text, bool l_complete = true) {
+    Summary _summary;
+    Json _root;
+    if (!Parser(l_text).parse(_root) || _root.type != 'o') return _summary;
+    const Json * _events = _root.member("traceEvents");
+    if (!_events || _events->type != 'a') return _summary;
+    _summary.valid = true;
+    std::map<std::string, std::vector<std::string>> _open;
+    std::map<std::string, double> _last;
+    for (const Json & event : _events->items) {
+        const Json * _phase = event.member("ph");
+        const Json * _name = event.member("name");
+        const Json * _thread = event.member("tid");
+        if (!_phase || !_name || !_thread || _phase->type != 's' || _thread->type != 'n') {
+            _summary.valid = false;
+            continue;
+        }
+        if (_phase->text == "M") continue;
+        const Json * _time = event.member("ts");
+        if (!_time || _time->type != 'n') {
+            _summary.valid = false;
+            continue;
+        }
+        double _ts = std::stod(_time->text);
+        if (_last.count(_thread->text) && _ts < _last[_thread->text]) _summary.ordered = false;
+        _last[_thread->text] = _ts;
+        std::vector<std::string> & _stack = _open[_thread->text];
+        if (_phase->text == "B") {
+            _stack.push_back(_name->text);
+        } else if (_phase->text == "E") {
+            if (_stack.empty() || _stack.back() != _name->text) {
+                // a ring that overflowed may have lost the begin of its oldest scopes
+                if (l_complete) _summary.paired = false;
+            } else {
+                _stack.pop_back();
+                _summary.scopes++;
+            }
+        } else if (_phase->text == "i") {
+            _summary.instants[_name->text]++;
+        } else {
+            _summary.valid = false;
+        }
+    }
+    for (const std::pair<const std::string, std::vector<std::string>> & open : _open) {
+        if (l_complete && !open.second.empty()) _summary.paired = false;
+    }
+    return _summary;
+}
+
+static std::string flushed() {
+    std::ostringstream _out;
+    Trace::flush(_out);
+    return _out.str();
+}
+
+static void pairsScopesOnEveryThread() {
+    Trace::clear();
+    auto _work = [](int l_depth) {
+        Trace::Scope _outer(Trace::VNT_BUILD, 1, 2, 3);
+        for (int i = 0; i < l_depth; i++) {
+            Trace::Scope _inner(Trace::VNT_FIND, i);
+            Trace::instant(Trace::ALLOCATE, 0x1000 + i, 64);
+        }
+    };
+    _work(3);
+    std::vector<std::thread> _threads;
+    for (int thread = 0; thread < 3; thread++) _threads.emplace_back(_work, 5);
+    for (std::thread & thread : _threads) thread.join();
+
+    // hooks of the library record as well
+    SafeMatrix<double> a{ { 1, 2 }, { 3, 4 } };
+    SafeMatrix<double> & _product = a * a;
+    delete & _product;
+
+    std::string _text = flushed();
+    Summary _summary = summarize(_text);
+    CHECK(_summary.valid && _summary.paired && _summary.ordered);
+    CHECK(_summary.scopes >= 4 + 3 * 6 + 1);
+    CHECK(_summary.instants["allocate"] >= 3 + 3 * 5);
+    CHECK(_text.find("\"name\":\"SafeMatrix::operator*\"") != std::string::npos);
+    CHECK(_text.find("\"args\":{\"size\":1,\"rows\":2,\"cols\":3}") != std::string::npos);
+    CHECK(_text.find("\"args\":{\"address\":4097,\"bytes\":64}") != std::string::npos);
+
+    // a flush empties the buffers
+    Summary _again = summarize(flushed());
+    CHECK(_again.valid && _again.scopes == 0 && _again.instants.empty());
+}
+
+static void keepsNewestEventsOfAFullRing() {
+    Trace::clear();
+    std::thread _writer([] {
+        for (uint64_t i = 0; i < 3 * 4096 + 10; i++) Trace::instant(Trace::FREE, i);
+    });
+    _writer.join();
+    std::string _text = flushed();
+    Summary _summary = summarize(_text);
+    CHECK(_summary.valid);
+    CHECK(_summary.instants["free"] >= 4095 && _summary.instants["free"] <= 4096);
+    CHECK(_text.find("\"address\":" + std::to_string(3 * 4096 + 9) + "}") != std::string::npos);
+    CHECK(_text.find("\"address\":" + std::to_string(2 * 4096) + "}") == std::string::npos);
+}
+
+static void flushesWhileThreadsRecord() {
+    Trace::clear();
+    std::atomic<bool> _stop(false);
+    std::vector<std::thread> _writers;
+    for (int thread = 0; thread < 2; thread++) {
+        _writers.emplace_back([&] {
+            while (!_stop.load(std::memory_order_relaxed)) {
+                Trace::Scope _scope(Trace::VNT_ADD, 7);
+                Trace::instant(Trace::ALLOCATE, 1, 2);
+            }
+        });
+    }
+    bool _valid = true;
+    for (int round = 0; round < 50; round++) {
+        // a concurrent flush may cut scopes at either end, but the events it keeps are whole
+        Summary _summary = summarize(flushed(), false);
+        _valid = _valid && _summary.valid && _summary.ordered;
+    }
+    _stop = true;
+    for (std::thread & writer : _writers) writer.join();
+    CHECK(_valid);
+}
+
+int main() {
+    pairsScopesOnEveryThread();
+    keepsNewestEventsOfAFullRing();
+    flushesWhileThreadsRecord();
+    return report("trace_test");
+}
@@ -0,0 +1,236 @@
+/*
+ * VNT: build, add, remove, extractMin, topK, kthSmallest and the batched queries checked against a sorted
+ * copy of the input, for the sentinel table, a ROWFILL table under std::greater and ConcurrentVNT
+ */
+
+#define SAFEARRAY_BLOCK_DEBUG false
+#define SAFEARRAY_VNT_DEBUG false
+
+#include <algorithm>
+#include <memory_resource>
+#include <random>
+#include <vector>
+#include "ConcurrentVNT.h"
+#include "Check.h"
+
+static const int MAX = 1 << 30;
+
+// occupied cells form a staircase at the top left and ascend along every row and down every column
+template <typename T, typename Compare>
+static bool ordered(const VNT<T, Compare> & l_VNT) {
+    Compare _less;
+    const SafeMatrix<T> & _table = * l_VNT.table;
+    int _total = 0;
+    for (int row = 0; row <= _table.rowHigh; row++) {
+        const T * _cells = _table.matrix[row]->constData();
+        int _fill = l_VNT.rowFill(row);
+        _total += _fill;
+        if (row > 0 && _fill > l_VNT.rowFill(row - 1)) return false;
+        for (int col = 0; col < _fill; col++) {
+            if (col > 0 && _less(_cells[col], _cells[col - 1])) return false;
+            if (row > 0 && _less(_cells[col], _table.matrix[row - 1]->constData()[col])) return false;
+        }
+    }
+    return _total == l_VNT.size();
+}
+
+static std::vector<int> randomElements(int l_size, unsigned l_seed) {
+    std::mt19937 _random(l_seed);
+    std::vector<int> _elements(l_size);
+    for (int & element : _elements) element = _random() % 1000;
+    return _elements;
+}
+
+static void buildsAndSelects() {
+    std::vector<int> _input = randomElements(50, 1);
+    VNT<int> t(8, 8, MAX, _input.data(), _input.size());
+    std::sort(_input.begin(), _input.end());
+    CHECK(t.size() == 50);
+    CHECK(ordered(t));
+
+    bool _selected = true;
+    for (int k = 1; k <= t.size(); k++) _selected = _selected && t.kthSmallest(k) == _input[k - 1];
+    CHECK(_selected);
+    CHECK(t.kthSmallest(0) == MAX && t.kthSmallest(51) == MAX);
+
+    SafeArray<int> _top = t.topK(10);
+    CHECK(_top.getHigh() == 9);
+    bool _smallest = true;
+    for (int i = 0; i < 10; i++) _smallest = _smallest && _top[i] == _input[i];
+    CHECK(_smallest);
+    CHECK(t.size() == 50);
+    CHECK(t.topK(100).getHigh() == 49);
+}
+
+static void answersBatches() {
+    std::vector<int> _input = randomElements(40, 2);
+    VNT<int> t(7, 7, MAX, _input.data(), _input.size());
+    std::sort(_input.begin(), _input.end());
+
+    SafeArray<int> _queries{ -1, 0, 250, 500, 999, 2000 };
+    SafeArray<int> _counts = t.countLessEqual(_queries);
+    SafeArray<int> _ranks = t.rank(_queries);
+    bool _counted = true;
+    for (int i = 0; i <= _queries.getHigh(); i++) {
+        int _value = _queries[i];
+        _counted = _counted && _counts[i] == t.countLessEqual(_value) && _ranks[i] == t.rank(_value)
+                   && _counts[i] == std::upper_bound(_input.begin(), _input.end(), _value) - _input.begin();
+    }
+    CHECK(_counted);
+
+    SafeArray<int> _lows{ 0, 100, 600 };
+    SafeArray<int> _highs{ 50, 500, 550 };
+    SafeArray<int> _ranges = t.countInRange(_lows, _highs);
+    CHECK(_ranges[0] == t.countInRange(0, 50) && _ranges[1] == t.countInRange(100, 500) && _ranges[2] == 0);
+
+    SafeArray<int> _ks{ 40, 1, 20 };
+    SafeArray<int> _kth = t.kthSmallest(_ks);
+    CHECK(_kth[0] == _input[39] && _kth[1] == _input[0] && _kth[2] == _input[19]);
+
+    // a batch is only read, so a copy of it keeps sharing
+    SafeArray<int> _batch{ 10, 20 };
+    SafeArray<int> _copy = _batch;
+    t.countLessEqual(_batch);
+    const SafeArray<int> & _shared = _batch;
+    CHECK(_shared.isShared());
+}
+
+static void removesAndExtracts() {
+    std::vector<int> _input = randomElements(30, 3);
+    VNT<int> t(6, 6, MAX);
+    for (int element : _input) t.add(element);
+    CHECK(t.size() == 30);
+    CHECK(ordered(t));
+
+    CHECK(t.remove(_input[7]));
+    CHECK(!t.remove(5000));
+    _input.erase(_input.begin() + 7);
+    std::sort(_input.begin(), _input.end());
+    CHECK(t.size() == 29);
+    CHECK(ordered(t));
+    CHECK(t.find(_input[12]) && !t.find(5000));
+
+    bool _ascending = true;
+    for (int element : _input) _ascending = _ascending && t.extractMin() == element;
+    CHECK(_ascending);
+    CHECK(t.isEmpty());
+    CHECK(t.extractMin() == MAX);
+}
+
+static void rejectsWhenFullOrAtLimit() {
+    VNT<int> t(2, 2, MAX);
+    t.add(MAX);
+    CHECK(t.size() == 0);
+    for (int element : { 4, 3, 2, 1, 0 }) t.add(element);
+    CHECK(t.size() == 4);
+    CHECK(!t.find(0));
+    CHECK(t.getMin() == 1);
+}
+
+// assignment copies the elements into the resource of the table assigned to, the source keeps its own
+static void assignsIntoOwnResource() {
+    std::pmr::monotonic_buffer_resource _source, _target;
+    std::vector<int> _input = randomElements(20, 6);
+    VNT<int> a(5, 4, VNT<int>::ROWFILL, _input.data(), _input.size(), & _source);
+    VNT<int> b(2, 2, VNT<int>::SENTINEL, & _target);
+    b = a;
+    CHECK(b.table->getResource() == & _target && a.table->getResource() == & _source);
+    CHECK(b.size() == 20 && ordered(b));
+    std::sort(_input.begin(), _input.end());
+    bool _ascending = true;
+    for (int element : _input) _ascending = _ascending && b.extractMin() == element;
+    CHECK(_ascending);
+    CHECK(a.size() == 20 && a.getMin() == _input[0]);
+
+    // tables in the same resource share their rows until one is written
+    VNT<int> c(1, 1, VNT<int>::ROWFILL, & _source);
+    c = a;
+    CHECK(c.table->getResource() == & _source && c.table->isShared());
+    c.extractMin();
+    CHECK(c.size() == 19 && a.size() == 20 && a.getMin() == _input[0] && c.getMin() == _input[1]);
+}
+
+// every element of the merged table arrives or, when one is beyond the _MAX of a SENTINEL table, none does
+static void mergesAllOrNothing() {
+    std::vector<int> _low = randomElements(6, 7), _high = randomElements(10, 8);
+    for (int & element : _low) element %= 100;
+    VNT<int> a(3, 3, 100, _low.data(), _low.size());
+
+    std::vector<int> _over{ 5, 150, 20 };
+    VNT<int> b(2, 2, VNT<int>::ROWFILL, _over.data(), _over.size());
+    CHECK(!a.merge(b));
+    VNT<int> c(2, 2, 1000);
+    c.add(100);
+    CHECK(!a.merge(c));
+    CHECK(a.size() == 6 && b.size() == 3 && c.size() == 1 && ordered(a));
+
+    // fits, added one by one
+    std::vector<int> _fits{ 99, 0, 42 };
+    VNT<int> d(2, 2, VNT<int>::ROWFILL, _fits.data(), _fits.size());
+    CHECK(a.merge(d));
+    CHECK(a.size() == 9 && a.capacity() == 9 && ordered(a));
+
+    // a ROWFILL table takes any element and grows by whole rows
+    VNT<int> e(2, 4, VNT<int>::ROWFILL, _high.data(), 8);
+    CHECK(e.merge(a) && e.merge(c));
+    CHECK(e.size() == 18 && e.capacity() == 20 && ordered(e));
+    std::vector<int> _all(_high.begin(), _high.begin() + 8);
+    _all.insert(_all.end(), _low.begin(), _low.end());
+    _all.insert(_all.end(), _fits.begin(), _fits.end());
+    _all.push_back(100);
+    std::sort(_all.begin(), _all.end());
+    bool _ascending = true;
+    for (int element : _all) _ascending = _ascending && e.extractMin() == element;
+    CHECK(_ascending && e.isEmpty());
+}
+
+static void ordersByCompare() {
+    std::vector<int> _input = randomElements(20, 4);
+    VNT<int, std::greater<int>> t(5, 5, VNT<int, std::greater<int>>::ROWFILL, _input.data(), _input.size());
+    std::sort(_input.begin(), _input.end(), std::greater<int>());
+    CHECK(ordered(t));
+    CHECK(t.extractMin() == _input[0]);
+    CHECK(t.kthSmallest(3) == _input[3]);
+    SafeArray<int> _top = t.topK(2);
+    CHECK(_top[0] == _input[1] && _top[1] == _input[2]);
+}
+
+static void selectsWithoutValueSearch() {
+    std::vector<double> _input{ 0.5, -1.25, 3.0, 2.5, 0.0, 7.75, -4.0 };
+    VNT<double> t(3, 3, 1e300, _input.data(), _input.size());
+    std::sort(_input.begin(), _input.end());
+    bool _selected = true;
+    for (int k = 1; k <= (int) _input.size(); k++) _selected = _selected && t.kthSmallest(k) == _input[k - 1];
+    CHECK(_selected);
+}
+
+static void concurrentQueueKeepsCount() {
+    ConcurrentVNT<int> _queue(3, 2, 2, MAX, ConcurrentVNT<int>::STRICT);
+    CHECK(!_queue.push(MAX));
+    CHECK(_queue.size() == 0);
+    for (int element = 11; element >= 0; element--) CHECK(_queue.push(element));
+    CHECK(!_queue.push(12));
+    CHECK(_queue.size() == 12);
+
+    int _element;
+    bool _ascending = true;
+    for (int expected = 0; expected < 12; expected++) {
+        _ascending = _ascending && _queue.tryPop(_element) && _element == expected;
+    }
+    CHECK(_ascending);
+    CHECK(!_queue.tryPop(_element));
+    CHECK(_queue.size() == 0);
+}
+
+int main() {
+    buildsAndSelects();
+    answersBatches();
+    removesAndExtracts();
+    rejectsWhenFullOrAtLimit();
+    assignsIntoOwnResource();
+    mergesAllOrNothing();
+    ordersByCompare();
+    selectsWithoutValueSearch();
+    concurrentQueueKeepsCount();
+    return report("vnt_test");
+}